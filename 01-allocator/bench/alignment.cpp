@@ -0,0 +1,57 @@
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#include "allocator.hpp"
+#include "bench.hpp"
+
+namespace {
+
+constexpr size_t kElements = 1 << 20;
+constexpr size_t kRepeats = 20;
+
+double Sum(const char* bytes, size_t count) {
+  double sums[4] = {0, 0, 0, 0};
+  for (size_t i = 0; i < count; ++i) {
+    double value;
+    std::memcpy(&value, bytes + i * sizeof(double), sizeof(double));
+    sums[i % 4] += value;
+  }
+  return sums[0] + sums[1] + sums[2] + sums[3];
+}
+
+void Fill(char* bytes, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    double value = static_cast<double>(i);
+    std::memcpy(bytes + i * sizeof(double), &value, sizeof(double));
+  }
+}
+
+void Report(const char* name, const char* bytes) {
+  double ns = bench::BestOf(kRepeats, [bytes] {
+    bench::DoNotOptimize(Sum(bytes, kElements));
+  });
+  std::cout << std::left << std::setw(24) << name << std::fixed
+            << std::setprecision(3) << ns / kElements << " ns/element\n";
+}
+
+}  // namespace
+
+int main() {
+  Allocator arena;
+  arena.makeAllocator(4 * kElements * sizeof(double));
+
+  // A one byte header in front of the array shifts every double off its
+  // natural boundary, so every eighth load straddles a cache line.
+  arena.alloc(1);
+  char* unaligned = arena.alloc(kElements * sizeof(double));
+  Fill(unaligned, kElements);
+
+  arena.alloc(1);
+  char* aligned = reinterpret_cast<char*>(arena.allocate<double>(kElements));
+  Fill(aligned, kElements);
+
+  std::cout << "sum over " << kElements << " arena-placed doubles\n";
+  Report("unaligned alloc", unaligned);
+  Report("aligned allocate<T>", aligned);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <limits>
+
+namespace bench {
+
+template <class T>
+inline void DoNotOptimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Runs function repeats times and returns the best wall time in nanoseconds.
+template <class Function>
+double BestOf(size_t repeats, Function&& function) {
+  double best = std::numeric_limits<double>::max();
+  for (size_t i = 0; i < repeats; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto finish = std::chrono::steady_clock::now();
+    best = std::min(
+        best, std::chrono::duration<double, std::nano>(finish - start).count());
+  }
+  return best;
+}
+
+}  // namespace bench
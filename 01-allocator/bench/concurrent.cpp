@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <barrier>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "allocator.hpp"
+#include "bench.hpp"
+#include "concurrent_allocator.hpp"
+
+namespace {
+
+constexpr size_t kAllocsPerThread = 1 << 20;
+constexpr size_t kBlock = 16;
+constexpr size_t kRepeats = 5;
+
+// Times threads running worker concurrently, best of kRepeats rounds. The
+// threads are started once and wait at a barrier between rounds, so a
+// round measures allocation rather than thread start-up, and state a
+// thread keeps (its ArenaRegistry arena) carries over. setup runs before
+// each round while every worker waits, so it may reset the shared arena.
+template <class Setup, class Worker>
+double Run(size_t threads, Setup&& setup, Worker&& worker) {
+  std::barrier start(threads + 1), finish(threads + 1);
+  std::vector<std::thread> pool;
+  for (size_t t = 0; t < threads; ++t) {
+    pool.emplace_back([&] {
+      for (size_t round = 0; round < kRepeats; ++round) {
+        start.arrive_and_wait();
+        worker();
+        finish.arrive_and_wait();
+      }
+    });
+  }
+  double best = 0;
+  for (size_t round = 0; round < kRepeats; ++round) {
+    setup();
+    double ns = bench::BestOf(1, [&] {
+      start.arrive_and_wait();
+      finish.arrive_and_wait();
+    });
+    best = round == 0 ? ns : std::min(best, ns);
+  }
+  for (std::thread& thread : pool) {
+    thread.join();
+  }
+  return best;
+}
+
+void Report(const char* name, size_t threads, double ns) {
+  double allocs = static_cast<double>(threads * kAllocsPerThread);
+  std::cout << std::left << std::setw(20) << name << std::setw(4) << threads
+            << std::fixed << std::setprecision(1) << allocs / ns * 1e3
+            << " Mallocs/s\n";
+}
+
+}  // namespace
+
+int main() {
+  size_t maxThreads =
+      std::max<size_t>(std::thread::hardware_concurrency(), 4);
+  std::cout << std::left << std::setw(20) << "variant" << std::setw(4)
+            << "thr"
+            << "throughput\n";
+
+  for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+    Allocator shared;
+    std::mutex mutex;
+    shared.makeAllocator(threads * kAllocsPerThread * kBlock);
+    double locked = Run(threads, [&] { shared.reset(); }, [&] {
+      for (size_t i = 0; i < kAllocsPerThread; ++i) {
+        std::lock_guard<std::mutex> lock(mutex);
+        bench::DoNotOptimize(shared.alloc(kBlock));
+      }
+    });
+    Report("mutex + Allocator", threads, locked);
+
+    ConcurrentAllocator concurrent;
+    concurrent.makeAllocator(threads * kAllocsPerThread * kBlock);
+    double atomic = Run(threads, [&] { concurrent.reset(); }, [&] {
+      for (size_t i = 0; i < kAllocsPerThread; ++i) {
+        bench::DoNotOptimize(concurrent.alloc(kBlock));
+      }
+    });
+    Report("ConcurrentAllocator", threads, atomic);
+
+    ArenaRegistry registry(kAllocsPerThread * kBlock);
+    double local = Run(threads, [&] { registry.advanceEpoch(); }, [&] {
+      Allocator& arena = registry.local();
+      for (size_t i = 0; i < kAllocsPerThread; ++i) {
+        bench::DoNotOptimize(arena.alloc(kBlock));
+      }
+    });
+    Report("ArenaRegistry", threads, local);
+  }
+}
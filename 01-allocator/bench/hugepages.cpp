@@ -0,0 +1,75 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "allocator.hpp"
+#include "bench.hpp"
+
+namespace {
+
+constexpr size_t kLine = 64;
+constexpr size_t kHops = size_t(1) << 23;
+constexpr size_t kRepeats = 3;
+
+const char* Name(Allocator::Backing backing) {
+  switch (backing) {
+    case Allocator::Backing::kHeap:
+      return "heap";
+    case Allocator::Backing::kMmap:
+      return "mmap";
+    case Allocator::Backing::kHugePages:
+      return "mmap + MAP_HUGETLB";
+  }
+  return "?";
+}
+
+// Links every cache line of the arena into one random cycle and measures
+// the latency of chasing it; with 4 KiB pages nearly every hop is also a
+// TLB miss once the arena outgrows the TLB reach.
+void Chase(size_t bytes, Allocator::Backing requested) {
+  Allocator arena;
+  arena.makeAllocator(bytes + kLine, requested);
+  size_t lines = bytes / kLine;
+  char* base = arena.alloc(lines * kLine, kLine);
+
+  std::vector<size_t> order(lines);
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin() + 1, order.end(), std::mt19937_64(42));
+  for (size_t i = 0; i < lines; ++i) {
+    char* from = base + order[i] * kLine;
+    char* to = base + order[(i + 1) % lines] * kLine;
+    *reinterpret_cast<char**>(from) = to;
+  }
+
+  double ns = bench::BestOf(kRepeats, [base] {
+    char* current = base;
+    for (size_t i = 0; i < kHops; ++i) {
+      current = *reinterpret_cast<char**>(current);
+    }
+    bench::DoNotOptimize(current);
+  });
+
+  std::string name = Name(arena.backing());
+  if (requested == Allocator::Backing::kHugePages &&
+      arena.backing() != requested) {
+    name = "mmap + MADV_HUGEPAGE";
+  }
+  std::cout << std::left << std::setw(24) << name << std::fixed
+            << std::setprecision(2) << ns / kHops << " ns/access\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  size_t megabytes = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1024;
+  size_t bytes = megabytes << 20;
+  std::cout << "random pointer chase over a " << megabytes << " MiB arena\n";
+  Chase(bytes, Allocator::Backing::kHeap);
+  Chase(bytes, Allocator::Backing::kMmap);
+  Chase(bytes, Allocator::Backing::kHugePages);
+}
@@ -0,0 +1,58 @@
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include "allocator.hpp"
+#include "arena_resource.hpp"
+#include "bench.hpp"
+
+namespace {
+
+constexpr size_t kRequests = 2000;
+constexpr size_t kRepeats = 10;
+
+// Builds the kind of short-lived containers a request handler creates.
+size_t HandleRequest(std::pmr::memory_resource* resource, size_t seed) {
+  std::pmr::vector<int> ids(resource);
+  std::pmr::map<int, std::pmr::string> names(resource);
+  for (size_t i = 0; i < 32; ++i) {
+    ids.push_back(static_cast<int>(seed + i));
+    names.emplace(static_cast<int>(i),
+                  std::pmr::string("name-of-a-request-field", resource));
+  }
+  return ids.size() + names.size();
+}
+
+void Report(const char* name, double ns) {
+  std::cout << std::left << std::setw(24) << name << std::fixed
+            << std::setprecision(1) << ns / kRequests << " ns/request\n";
+}
+
+}  // namespace
+
+int main() {
+  double heap = bench::BestOf(kRepeats, [] {
+    for (size_t i = 0; i < kRequests; ++i) {
+      bench::DoNotOptimize(
+          HandleRequest(std::pmr::new_delete_resource(), i));
+    }
+  });
+
+  Allocator arena;
+  arena.makeGrowableAllocator(1 << 16);
+  ArenaResource resource(arena);
+  double bump = bench::BestOf(kRepeats, [&] {
+    for (size_t i = 0; i < kRequests; ++i) {
+      bench::DoNotOptimize(HandleRequest(&resource, i));
+      arena.reset();
+    }
+  });
+
+  std::cout << "vector + map<int, string> per request, " << kRequests
+            << " requests\n";
+  Report("new_delete_resource", heap);
+  Report("ArenaResource", bump);
+}
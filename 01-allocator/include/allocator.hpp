@@ -1,17 +1,136 @@
 #pragma once
 #include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <vector>
+
+#include "allocator_stats.hpp"
 
 class Allocator {
  public:
+  // Position of the bump pointer; only valid until the next reset() or
+  // makeAllocator().
+  struct Marker {
+    size_t chunk;
+    size_t offset;
+    size_t committed;
+  };
+
+  enum class Backing {
+    kHeap,
+    // Anonymous mapping with MAP_NORESERVE: pages are committed on first
+    // touch, so a large arena costs nothing until it is used.
+    kMmap,
+    // Tries MAP_HUGETLB first, then falls back to a 2 MiB aligned kMmap
+    // region advised with MADV_HUGEPAGE.
+    kHugePages,
+  };
+
   Allocator();
   ~Allocator();
 
-  void makeAllocator(size_t maxSize);
+  Allocator(const Allocator&) = delete;
+  Allocator& operator=(const Allocator&) = delete;
+
+  void makeAllocator(size_t maxSize, Backing backing = Backing::kHeap);
+  // Starts with one chunk of initialSize bytes and chains a chunk twice as
+  // large whenever the current one is exhausted. Chunks survive reset(), so
+  // a warmed-up arena stops touching the heap.
+  void makeGrowableAllocator(size_t initialSize,
+                             Backing backing = Backing::kHeap);
   char* alloc(size_t size);
+  // Returns a block whose address is a multiple of alignment (a power of
+  // two), or nullptr if the padded request does not fit.
+  char* alloc(size_t size, size_t alignment);
   void reset();
 
+  Marker mark() const;
+  // Releases everything allocated after marker was taken in O(1). Chunks
+  // entered since then stay in the chain for reuse.
+  void rewind(Marker marker);
+
+  template <class T>
+  T* allocate(size_t n) {
+    if (n > SIZE_MAX / sizeof(T)) {
+      return nullptr;
+    }
+    return reinterpret_cast<T*>(alloc(n * sizeof(T), alignof(T)));
+  }
+
+  template <class T, class... Args>
+  T* construct(Args&&... args) {
+    char* place = alloc(sizeof(T), alignof(T));
+    if (place == nullptr) {
+      return nullptr;
+    }
+    return new (place) T(std::forward<Args>(args)...);
+  }
+
+  // Bytes consumed since the last reset, including alignment padding and
+  // the unused tails of chunks that were skipped over.
+  size_t used() const;
+  // Largest used() value observed since the arena was made.
+  size_t highWaterMark() const;
+  size_t capacity() const;
+  size_t chunkCount() const;
+  // Backing actually obtained for the first chunk; kHugePages degrades to
+  // kMmap when explicit huge pages are unavailable.
+  Backing backing() const;
+
+#ifdef ALLOCATOR_STATS
+  // Snapshot of the counters with peakUsage filled from highWaterMark().
+  AllocatorStats stats() const;
+#endif
+
  private:
+  struct Chunk {
+    char* memory;
+    size_t capacity;
+    size_t mapped;
+    Backing backing;
+  };
+
+  static Chunk newChunk(size_t size, Backing backing);
+  static void freeChunk(const Chunk& chunk);
+
+  char* bump(size_t size, size_t alignment);
+  char* grow(size_t size, size_t alignment);
+  void enterChunk(size_t index);
+  void release();
+
+  char* record(size_t size, char* allocated) {
+    stats_.recordAlloc(size, allocated != nullptr);
+    return allocated;
+  }
+
+  std::vector<Chunk> chunks_;
+  size_t current_;
+  size_t committed_;
+  size_t highWater_;
+  bool growable_;
+  Backing backing_;
+  [[no_unique_address]] std::conditional_t<kAllocatorStats, AllocatorStats,
+                                           NullAllocatorStats> stats_;
+
+  // Cached view of chunks_[current_] for the fast path.
   char* memory_;
   size_t reserve_;
   size_t capacity_;
 };
+
+// Rewinds the arena to where it was when the scope was opened.
+class ArenaScope {
+ public:
+  explicit ArenaScope(Allocator& arena)
+      : arena_(arena), marker_(arena.mark()) {}
+  ~ArenaScope() { arena_.rewind(marker_); }
+
+  ArenaScope(const ArenaScope&) = delete;
+  ArenaScope& operator=(const ArenaScope&) = delete;
+
+ private:
+  Allocator& arena_;
+  Allocator::Marker marker_;
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef ALLOCATOR_STATS
+inline constexpr bool kAllocatorStats = true;
+#else
+inline constexpr bool kAllocatorStats = false;
+#endif
+
+// Counters an Allocator keeps when built with -DALLOCATOR_STATS.
+struct AllocatorStats {
+  // Bucket i holds requests of [2^(i-1), 2^i) bytes, bucket 0 the empty
+  // ones and the last bucket everything larger.
+  static constexpr size_t kSizeClasses = 16;
+
+  uint64_t allocations = 0;
+  uint64_t failedAllocations = 0;
+  uint64_t bytesAllocated = 0;
+  uint64_t resets = 0;
+  size_t peakUsage = 0;
+  std::array<uint64_t, kSizeClasses> histogram{};
+
+  static size_t sizeClass(size_t size);
+
+  void recordAlloc(size_t size, bool succeeded);
+  void recordReset() { ++resets; }
+
+  std::string toJson() const;
+};
+
+// Stand-in used when statistics are compiled out; every call folds away.
+struct NullAllocatorStats {
+  void recordAlloc(size_t, bool) {}
+  void recordReset() {}
+};
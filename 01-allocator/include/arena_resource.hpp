@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <memory_resource>
+
+#include "allocator.hpp"
+
+// Lets std::pmr containers draw from an Allocator. Memory is only returned
+// to the arena by reset() or rewind(), so deallocate does nothing.
+class ArenaResource : public std::pmr::memory_resource {
+ public:
+  explicit ArenaResource(Allocator& arena);
+
+  Allocator& arena() const;
+
+ private:
+  void* do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void* ptr, size_t bytes, size_t alignment) override;
+  bool do_is_equal(
+      const std::pmr::memory_resource& other) const noexcept override;
+
+  Allocator& arena_;
+};
@@ -0,0 +1,80 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "allocator.hpp"
+
+// Bump arena that many threads may allocate from at once. A reservation is
+// a compare-and-swap loop on the offset that never moves it past the
+// capacity, so a request that does not fit fails without side effects.
+// makeAllocator() and reset() must not race with alloc().
+class ConcurrentAllocator {
+ public:
+  ConcurrentAllocator();
+  ~ConcurrentAllocator();
+
+  ConcurrentAllocator(const ConcurrentAllocator&) = delete;
+  ConcurrentAllocator& operator=(const ConcurrentAllocator&) = delete;
+
+  void makeAllocator(size_t maxSize);
+  char* alloc(size_t size);
+  char* alloc(size_t size, size_t alignment);
+  void reset();
+
+  size_t used() const;
+
+ private:
+  char* memory_;
+  size_t capacity_;
+  std::atomic<size_t> reserve_;
+};
+
+// Gives every thread its own growable Allocator. advanceEpoch() retires all
+// of them in O(1): each arena is reset lazily the next time its owner calls
+// local(), so memory from an old epoch must not be used after that call.
+// A thread that exits hands its arena back, and the next thread to
+// register takes it over as it is; what it holds stays valid until the
+// epoch advances. The number of arenas is thus the peak number of threads.
+class ArenaRegistry {
+ public:
+  explicit ArenaRegistry(size_t chunkSize);
+  ~ArenaRegistry();
+
+  ArenaRegistry(const ArenaRegistry&) = delete;
+  ArenaRegistry& operator=(const ArenaRegistry&) = delete;
+
+  Allocator& local();
+  void advanceEpoch();
+
+  uint64_t epoch() const;
+  size_t arenaCount() const;
+
+ private:
+  struct Slot {
+    Allocator arena;
+    uint64_t epoch;
+  };
+
+  // Owned jointly with exiting threads, which may hand a slot back while
+  // the registry is being destroyed.
+  struct Shared {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Slot>> slots;
+    // Slots of exited threads, waiting for a new owner.
+    std::vector<Slot*> free;
+  };
+
+  // Per-thread map from registry id to the thread's slot.
+  struct ThreadTable;
+
+  Slot* registerThread();
+
+  const uint64_t id_;
+  const size_t chunkSize_;
+  std::atomic<uint64_t> epoch_;
+  std::shared_ptr<Shared> shared_;
+};
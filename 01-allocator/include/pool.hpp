@@ -0,0 +1,104 @@
+#pragma once
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// Hands out blocks of one size carved from slabs. Freed blocks go onto an
+// intrusive free list, so both allocate and deallocate are O(1).
+class FixedPool {
+ public:
+  explicit FixedPool(size_t blockSize, size_t blocksPerSlab = 64);
+  ~FixedPool();
+
+  FixedPool(const FixedPool&) = delete;
+  FixedPool& operator=(const FixedPool&) = delete;
+
+  void* allocate();
+  void deallocate(void* block);
+
+  size_t blockSize() const;
+  size_t slabCount() const;
+
+ private:
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  void addSlab();
+
+  size_t blockSize_;
+  size_t blocksPerSlab_;
+  FreeBlock* free_;
+  std::vector<char*> slabs_;
+};
+
+// One FixedPool per 16-byte size class up to kMaxBlock; larger or
+// over-aligned requests fall through to the global heap. A pool is only
+// thread-safe if it was constructed synchronized, which costs a mutex per
+// pooled call; instance() is.
+class SizeClassPool {
+ public:
+  static constexpr size_t kGranularity = alignof(std::max_align_t);
+  static constexpr size_t kMaxBlock = 256;
+
+  explicit SizeClassPool(bool synchronized = false);
+
+  SizeClassPool(const SizeClassPool&) = delete;
+  SizeClassPool& operator=(const SizeClassPool&) = delete;
+
+  void* allocate(size_t bytes, size_t alignment);
+  void deallocate(void* ptr, size_t bytes, size_t alignment);
+
+  // Synchronized pool used by default-constructed PoolAllocators, so
+  // containers on different threads may share it.
+  static SizeClassPool& instance();
+
+ private:
+  static bool pooled(size_t bytes, size_t alignment);
+
+  std::vector<std::unique_ptr<FixedPool>> classes_;
+  bool synchronized_;
+  std::mutex mutex_;
+};
+
+// STL allocator over a SizeClassPool. Default construction binds to
+// SizeClassPool::instance(), so node containers that default-construct
+// their allocator (std::map, TBalancedTree) can take it as a template
+// argument directly.
+template <class T>
+class PoolAllocator {
+ public:
+  using value_type = T;
+
+  PoolAllocator() noexcept : pool_(&SizeClassPool::instance()) {}
+  explicit PoolAllocator(SizeClassPool& pool) noexcept : pool_(&pool) {}
+  template <class U>
+  PoolAllocator(const PoolAllocator<U>& other) noexcept
+      : pool_(other.pool()) {}
+
+  // Throws std::bad_array_new_length when n * sizeof(T) overflows, as
+  // std::allocator does.
+  T* allocate(size_t n) {
+    if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+      throw std::bad_array_new_length();
+    }
+    return static_cast<T*>(pool_->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T* ptr, size_t n) {
+    pool_->deallocate(ptr, n * sizeof(T), alignof(T));
+  }
+
+  SizeClassPool* pool() const { return pool_; }
+
+  template <class U>
+  bool operator==(const PoolAllocator<U>& other) const {
+    return pool_ == other.pool();
+  }
+
+ private:
+  SizeClassPool* pool_;
+};
@@ -1,26 +1,218 @@
 #include "allocator.hpp"
 
-Allocator::Allocator() : memory_(nullptr), reserve_(0), capacity_(0) {}
+#include <sys/mman.h>
 
-Allocator::~Allocator() { delete[] memory_; }
+#include <algorithm>
+#include <cstdint>
+#include <new>
 
-void Allocator::makeAllocator(size_t maxSize) {
-  if (memory_ != nullptr) {
-    delete[] memory_;
-    reserve_ = 0;
-  }
-  memory_ = new char[maxSize];
-  capacity_ = maxSize;
+namespace {
+
+constexpr size_t kHugePageSize = size_t(2) << 20;
+
+size_t RoundUp(size_t value, size_t granularity) {
+  return (value + granularity - 1) / granularity * granularity;
+}
+
+char* MapAnonymous(size_t length, int extraFlags) {
+  void* memory = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | extraFlags, -1, 0);
+  return memory == MAP_FAILED ? nullptr : static_cast<char*>(memory);
+}
+
+}  // namespace
+
+Allocator::Allocator()
+    : current_(0),
+      committed_(0),
+      highWater_(0),
+      growable_(false),
+      backing_(Backing::kHeap),
+      memory_(nullptr),
+      reserve_(0),
+      capacity_(0) {}
+
+Allocator::~Allocator() { release(); }
+
+void Allocator::makeAllocator(size_t maxSize, Backing backing) {
+  release();
+  backing_ = backing;
+  chunks_.push_back(newChunk(maxSize, backing));
+  enterChunk(0);
+}
+
+void Allocator::makeGrowableAllocator(size_t initialSize, Backing backing) {
+  makeAllocator(initialSize, backing);
+  growable_ = true;
 }
 
 char* Allocator::alloc(size_t size) {
   if ((capacity_ - reserve_) < size) {
-    return nullptr;
+    return record(size, growable_ ? grow(size, 1) : nullptr);
   } else {
     char* allocated = memory_ + reserve_;
     reserve_ += size;
-    return allocated;
+    return record(size, allocated);
+  }
+}
+
+char* Allocator::alloc(size_t size, size_t alignment) {
+  if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+    return record(size, nullptr);
+  }
+  char* allocated = bump(size, alignment);
+  if (allocated == nullptr && growable_) {
+    allocated = grow(size, alignment);
+  }
+  return record(size, allocated);
+}
+
+void Allocator::reset() {
+  stats_.recordReset();
+  highWater_ = std::max(highWater_, used());
+  if (!chunks_.empty()) {
+    committed_ = 0;
+    enterChunk(0);
   }
 }
 
-void Allocator::reset() { reserve_ = 0; }
+Allocator::Marker Allocator::mark() const {
+  return {current_, reserve_, committed_};
+}
+
+void Allocator::rewind(Marker marker) {
+  if (chunks_.empty()) {
+    return;
+  }
+  highWater_ = std::max(highWater_, used());
+  if (marker.chunk != current_) {
+    enterChunk(marker.chunk);
+  }
+  committed_ = marker.committed;
+  reserve_ = marker.offset;
+}
+
+size_t Allocator::used() const { return committed_ + reserve_; }
+
+size_t Allocator::highWaterMark() const {
+  return std::max(highWater_, used());
+}
+
+size_t Allocator::capacity() const {
+  size_t total = 0;
+  for (const Chunk& chunk : chunks_) {
+    total += chunk.capacity;
+  }
+  return total;
+}
+
+size_t Allocator::chunkCount() const { return chunks_.size(); }
+
+Allocator::Backing Allocator::backing() const {
+  return chunks_.empty() ? backing_ : chunks_.front().backing;
+}
+
+#ifdef ALLOCATOR_STATS
+AllocatorStats Allocator::stats() const {
+  AllocatorStats snapshot = stats_;
+  snapshot.peakUsage = highWaterMark();
+  return snapshot;
+}
+#endif
+
+Allocator::Chunk Allocator::newChunk(size_t size, Backing backing) {
+  if (backing == Backing::kHeap) {
+    return {new char[size], size, size, Backing::kHeap};
+  }
+  if (backing == Backing::kHugePages) {
+    size_t length = RoundUp(std::max<size_t>(size, 1), kHugePageSize);
+    // MAP_NORESERVE is left out on purpose: without it the kernel reserves
+    // the huge pages up front and fails here instead of raising SIGBUS on
+    // first touch.
+    if (char* memory = MapAnonymous(length, MAP_HUGETLB)) {
+      return {memory, size, length, Backing::kHugePages};
+    }
+    // No reserved hugetlbfs pages: over-map so a 2 MiB aligned window can
+    // be cut out, trim the slack and ask for transparent huge pages.
+    char* raw = MapAnonymous(length + kHugePageSize, MAP_NORESERVE);
+    if (raw == nullptr) {
+      throw std::bad_alloc();
+    }
+    uintptr_t address = reinterpret_cast<uintptr_t>(raw);
+    size_t head = RoundUp(address, kHugePageSize) - address;
+    if (head != 0) {
+      munmap(raw, head);
+    }
+    munmap(raw + head + length, kHugePageSize - head);
+    char* memory = raw + head;
+    madvise(memory, length, MADV_HUGEPAGE);
+    return {memory, size, length, Backing::kMmap};
+  }
+  size_t length = std::max<size_t>(size, 1);
+  char* memory = MapAnonymous(length, MAP_NORESERVE);
+  if (memory == nullptr) {
+    throw std::bad_alloc();
+  }
+  return {memory, size, length, Backing::kMmap};
+}
+
+void Allocator::freeChunk(const Chunk& chunk) {
+  if (chunk.backing == Backing::kHeap) {
+    delete[] chunk.memory;
+  } else {
+    munmap(chunk.memory, chunk.mapped);
+  }
+}
+
+char* Allocator::bump(size_t size, size_t alignment) {
+  uintptr_t current = reinterpret_cast<uintptr_t>(memory_ + reserve_);
+  size_t padding = (alignment - (current & (alignment - 1))) & (alignment - 1);
+  size_t available = capacity_ - reserve_;
+  if (available < padding || (available - padding) < size) {
+    return nullptr;
+  }
+  char* allocated = memory_ + reserve_ + padding;
+  reserve_ += padding + size;
+  return allocated;
+}
+
+char* Allocator::grow(size_t size, size_t alignment) {
+  if (size > SIZE_MAX - alignment) {
+    return nullptr;
+  }
+  while (true) {
+    committed_ += capacity_;
+    if (current_ + 1 == chunks_.size()) {
+      size_t next = std::max(chunks_.back().capacity * 2, size + alignment);
+      chunks_.push_back(newChunk(next, backing_));
+    }
+    enterChunk(current_ + 1);
+    char* allocated = bump(size, alignment);
+    if (allocated != nullptr) {
+      return allocated;
+    }
+  }
+}
+
+void Allocator::enterChunk(size_t index) {
+  current_ = index;
+  memory_ = chunks_[index].memory;
+  capacity_ = chunks_[index].capacity;
+  reserve_ = 0;
+}
+
+void Allocator::release() {
+  for (const Chunk& chunk : chunks_) {
+    freeChunk(chunk);
+  }
+  chunks_.clear();
+  current_ = 0;
+  committed_ = 0;
+  highWater_ = 0;
+  growable_ = false;
+  backing_ = Backing::kHeap;
+  stats_ = {};
+  memory_ = nullptr;
+  reserve_ = 0;
+  capacity_ = 0;
+}
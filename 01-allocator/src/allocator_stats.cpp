@@ -0,0 +1,33 @@
+#include "allocator_stats.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <sstream>
+
+size_t AllocatorStats::sizeClass(size_t size) {
+  return std::min<size_t>(std::bit_width(size), kSizeClasses - 1);
+}
+
+void AllocatorStats::recordAlloc(size_t size, bool succeeded) {
+  if (!succeeded) {
+    ++failedAllocations;
+    return;
+  }
+  ++allocations;
+  bytesAllocated += size;
+  ++histogram[sizeClass(size)];
+}
+
+std::string AllocatorStats::toJson() const {
+  std::ostringstream os;
+  os << "{\"allocations\": " << allocations
+     << ", \"failed_allocations\": " << failedAllocations
+     << ", \"bytes_allocated\": " << bytesAllocated
+     << ", \"resets\": " << resets << ", \"peak_usage\": " << peakUsage
+     << ", \"histogram\": [";
+  for (size_t i = 0; i < kSizeClasses; ++i) {
+    os << (i == 0 ? "" : ", ") << histogram[i];
+  }
+  os << "]}";
+  return os.str();
+}
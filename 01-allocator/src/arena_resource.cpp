@@ -0,0 +1,22 @@
+#include "arena_resource.hpp"
+
+#include <new>
+
+ArenaResource::ArenaResource(Allocator& arena) : arena_(arena) {}
+
+Allocator& ArenaResource::arena() const { return arena_; }
+
+void* ArenaResource::do_allocate(size_t bytes, size_t alignment) {
+  char* allocated = arena_.alloc(bytes, alignment);
+  if (allocated == nullptr) {
+    throw std::bad_alloc();
+  }
+  return allocated;
+}
+
+void ArenaResource::do_deallocate(void*, size_t, size_t) {}
+
+bool ArenaResource::do_is_equal(
+    const std::pmr::memory_resource& other) const noexcept {
+  return this == &other;
+}
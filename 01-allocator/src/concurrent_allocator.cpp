@@ -0,0 +1,161 @@
+#include "concurrent_allocator.hpp"
+
+#include <unordered_map>
+
+ConcurrentAllocator::ConcurrentAllocator()
+    : memory_(nullptr), capacity_(0), reserve_(0) {}
+
+ConcurrentAllocator::~ConcurrentAllocator() { delete[] memory_; }
+
+void ConcurrentAllocator::makeAllocator(size_t maxSize) {
+  delete[] memory_;
+  memory_ = new char[maxSize];
+  capacity_ = maxSize;
+  reserve_.store(0, std::memory_order_relaxed);
+}
+
+char* ConcurrentAllocator::alloc(size_t size) {
+  // Only a request that fits moves the offset, so a failed one neither
+  // wraps it nor starves smaller requests that would still fit.
+  size_t offset = reserve_.load(std::memory_order_relaxed);
+  do {
+    if (capacity_ - offset < size) {
+      return nullptr;
+    }
+  } while (!reserve_.compare_exchange_weak(offset, offset + size,
+                                           std::memory_order_relaxed));
+  return memory_ + offset;
+}
+
+char* ConcurrentAllocator::alloc(size_t size, size_t alignment) {
+  if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+    return nullptr;
+  }
+  size_t offset = reserve_.load(std::memory_order_relaxed);
+  while (true) {
+    uintptr_t current = reinterpret_cast<uintptr_t>(memory_ + offset);
+    size_t padding =
+        (alignment - (current & (alignment - 1))) & (alignment - 1);
+    size_t available = capacity_ - offset;
+    if (available < padding || (available - padding) < size) {
+      return nullptr;
+    }
+    if (reserve_.compare_exchange_weak(offset, offset + padding + size,
+                                       std::memory_order_relaxed)) {
+      return memory_ + offset + padding;
+    }
+  }
+}
+
+void ConcurrentAllocator::reset() {
+  reserve_.store(0, std::memory_order_relaxed);
+}
+
+size_t ConcurrentAllocator::used() const {
+  return reserve_.load(std::memory_order_relaxed);
+}
+
+namespace {
+
+std::atomic<uint64_t> nextRegistryId{0};
+
+}  // namespace
+
+struct ArenaRegistry::ThreadTable {
+  struct Entry {
+    std::weak_ptr<Shared> owner;
+    Slot* slot;
+  };
+
+  ThreadTable() { current = this; }
+
+  // Hands every slot back to its registry, if that still exists.
+  ~ThreadTable() {
+    current = nullptr;
+    for (auto& [id, entry] : entries) {
+      if (std::shared_ptr<Shared> owner = entry.owner.lock()) {
+        std::lock_guard<std::mutex> lock(owner->mutex);
+        owner->free.push_back(entry.slot);
+      }
+    }
+  }
+
+  // Drops the entries of registries destroyed on other threads.
+  void prune() {
+    std::erase_if(entries, [](const auto& item) {
+      return item.second.owner.expired();
+    });
+  }
+
+  // The table of this thread while it exists; a registry destroyed after
+  // it, such as a static one at exit, finds nullptr.
+  static thread_local ThreadTable* current;
+
+  std::unordered_map<uint64_t, Entry> entries;
+};
+
+thread_local ArenaRegistry::ThreadTable* ArenaRegistry::ThreadTable::current =
+    nullptr;
+
+ArenaRegistry::ArenaRegistry(size_t chunkSize)
+    : id_(nextRegistryId.fetch_add(1, std::memory_order_relaxed)),
+      chunkSize_(chunkSize),
+      epoch_(0),
+      shared_(std::make_shared<Shared>()) {}
+
+ArenaRegistry::~ArenaRegistry() {
+  if (ThreadTable::current != nullptr) {
+    ThreadTable::current->entries.erase(id_);
+  }
+}
+
+Allocator& ArenaRegistry::local() {
+  // Registries are keyed by a never-reused id rather than their address,
+  // so a registry built where a destroyed one lived gets fresh slots.
+  thread_local ThreadTable table;
+  auto it = table.entries.find(id_);
+  if (it == table.entries.end()) {
+    table.prune();
+    ThreadTable::Entry entry{shared_, registerThread()};
+    it = table.entries.emplace(id_, std::move(entry)).first;
+  }
+  Slot* slot = it->second.slot;
+  uint64_t current = epoch_.load(std::memory_order_acquire);
+  if (slot->epoch != current) {
+    slot->arena.reset();
+    slot->epoch = current;
+  }
+  return slot->arena;
+}
+
+void ArenaRegistry::advanceEpoch() {
+  epoch_.fetch_add(1, std::memory_order_acq_rel);
+}
+
+uint64_t ArenaRegistry::epoch() const {
+  return epoch_.load(std::memory_order_acquire);
+}
+
+size_t ArenaRegistry::arenaCount() const {
+  std::lock_guard<std::mutex> lock(shared_->mutex);
+  return shared_->slots.size();
+}
+
+ArenaRegistry::Slot* ArenaRegistry::registerThread() {
+  {
+    // A slot handed back keeps its epoch, so local() resets it only once
+    // the epoch has moved on.
+    std::lock_guard<std::mutex> lock(shared_->mutex);
+    if (!shared_->free.empty()) {
+      Slot* slot = shared_->free.back();
+      shared_->free.pop_back();
+      return slot;
+    }
+  }
+  auto slot = std::make_unique<Slot>();
+  slot->arena.makeGrowableAllocator(chunkSize_);
+  slot->epoch = epoch_.load(std::memory_order_acquire);
+  std::lock_guard<std::mutex> lock(shared_->mutex);
+  shared_->slots.push_back(std::move(slot));
+  return shared_->slots.back().get();
+}
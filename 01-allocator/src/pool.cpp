@@ -0,0 +1,101 @@
+#include "pool.hpp"
+
+#include <algorithm>
+#include <new>
+
+namespace {
+
+size_t RoundUp(size_t value, size_t granularity) {
+  return (value + granularity - 1) / granularity * granularity;
+}
+
+}  // namespace
+
+FixedPool::FixedPool(size_t blockSize, size_t blocksPerSlab)
+    : blockSize_(RoundUp(std::max(blockSize, sizeof(FreeBlock)),
+                         alignof(std::max_align_t))),
+      blocksPerSlab_(std::max<size_t>(blocksPerSlab, 1)),
+      free_(nullptr) {}
+
+FixedPool::~FixedPool() {
+  for (char* slab : slabs_) {
+    delete[] slab;
+  }
+}
+
+void* FixedPool::allocate() {
+  if (free_ == nullptr) {
+    addSlab();
+  }
+  FreeBlock* block = free_;
+  free_ = block->next;
+  return block;
+}
+
+void FixedPool::deallocate(void* block) {
+  if (block == nullptr) {
+    return;
+  }
+  FreeBlock* freed = static_cast<FreeBlock*>(block);
+  freed->next = free_;
+  free_ = freed;
+}
+
+size_t FixedPool::blockSize() const { return blockSize_; }
+
+size_t FixedPool::slabCount() const { return slabs_.size(); }
+
+void FixedPool::addSlab() {
+  char* slab = new char[blockSize_ * blocksPerSlab_];
+  slabs_.push_back(slab);
+  // Thread the fresh blocks in address order so consecutive allocations
+  // walk the slab forwards.
+  for (size_t i = blocksPerSlab_; i > 0; --i) {
+    char* address = slab + (i - 1) * blockSize_;
+    FreeBlock* block = reinterpret_cast<FreeBlock*>(address);
+    block->next = free_;
+    free_ = block;
+  }
+}
+
+SizeClassPool::SizeClassPool(bool synchronized)
+    : synchronized_(synchronized) {
+  for (size_t size = kGranularity; size <= kMaxBlock; size += kGranularity) {
+    classes_.push_back(std::make_unique<FixedPool>(size));
+  }
+}
+
+void* SizeClassPool::allocate(size_t bytes, size_t alignment) {
+  if (!pooled(bytes, alignment)) {
+    return ::operator new(bytes, std::align_val_t(alignment));
+  }
+  FixedPool& pool = *classes_[(bytes - 1) / kGranularity];
+  if (!synchronized_) {
+    return pool.allocate();
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pool.allocate();
+}
+
+void SizeClassPool::deallocate(void* ptr, size_t bytes, size_t alignment) {
+  if (!pooled(bytes, alignment)) {
+    ::operator delete(ptr, bytes, std::align_val_t(alignment));
+    return;
+  }
+  FixedPool& pool = *classes_[(bytes - 1) / kGranularity];
+  if (!synchronized_) {
+    pool.deallocate(ptr);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  pool.deallocate(ptr);
+}
+
+SizeClassPool& SizeClassPool::instance() {
+  static SizeClassPool pool(true);
+  return pool;
+}
+
+bool SizeClassPool::pooled(size_t bytes, size_t alignment) {
+  return bytes != 0 && bytes <= kMaxBlock && alignment <= kGranularity;
+}
@@ -1,13 +1,32 @@
 #include <gtest/gtest.h>
 
+#include <atomic>
 #include <iostream>
+#include <list>
+#include <map>
+#include <memory_resource>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "allocator.hpp"
+#include "arena_resource.hpp"
+#include "concurrent_allocator.hpp"
+#include "pool.hpp"
 
 #define TEST_1
 #define TEST_2
 #define TEST_3
 #define TEST_4
+#define TEST_5
+#define TEST_6
+#define TEST_7
+#define TEST_8
+#define TEST_9
+#define TEST_10
+#define TEST_11
+#define TEST_12
 
 #ifdef TEST_1
 TEST(TestBase, Create_Delete) {
@@ -78,6 +97,469 @@ TEST(TestReset, Reset) {
 }
 #endif  // TEST_4
 
+#ifdef TEST_5
+TEST(TestAlign, AlignedAllocate) {
+  Allocator alloc;
+  alloc.makeAllocator(1024);
+  ASSERT_TRUE(alloc.alloc(1) != nullptr);
+  for (size_t alignment : {2, 8, 16, 64}) {
+    char* ptr = alloc.alloc(3, alignment);
+    ASSERT_TRUE(ptr != nullptr);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(ptr) % alignment, 0);
+  }
+  ASSERT_TRUE(alloc.alloc(1, 3) == nullptr);
+  ASSERT_TRUE(alloc.alloc(1, 0) == nullptr);
+  ASSERT_TRUE(alloc.alloc(2048, 1) == nullptr);
+}
+
+TEST(TestAlign, TypedHelpers) {
+  struct alignas(64) Line {
+    explicit Line(int value) : value(value) {}
+    int value;
+  };
+
+  Allocator alloc;
+  alloc.makeAllocator(1024);
+  ASSERT_TRUE(alloc.alloc(1) != nullptr);
+
+  double* values = alloc.allocate<double>(8);
+  ASSERT_TRUE(values != nullptr);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(values) % alignof(double), 0);
+
+  Line* line = alloc.construct<Line>(42);
+  ASSERT_TRUE(line != nullptr);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(line) % 64, 0);
+  ASSERT_EQ(line->value, 42);
+
+  ASSERT_TRUE(alloc.allocate<double>(SIZE_MAX / 4) == nullptr);
+  ASSERT_TRUE(alloc.construct<Line>(1) != nullptr);
+  alloc.reset();
+  ASSERT_TRUE(alloc.allocate<char>(1024) != nullptr);
+}
+#endif  // TEST_5
+
+#ifdef TEST_6
+TEST(TestGrowable, ChainsChunks) {
+  Allocator alloc;
+  alloc.makeGrowableAllocator(16);
+  ASSERT_EQ(alloc.chunkCount(), 1);
+  for (size_t i = 0; i < 100; ++i) {
+    ASSERT_TRUE(alloc.alloc(1) != nullptr);
+  }
+  ASSERT_GT(alloc.chunkCount(), 1);
+  ASSERT_GE(alloc.capacity(), 100);
+  ASSERT_GE(alloc.used(), 100);
+
+  char* big = alloc.alloc(1000, 64);
+  ASSERT_TRUE(big != nullptr);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(big) % 64, 0);
+}
+
+TEST(TestGrowable, ReusesChunksAfterReset) {
+  Allocator alloc;
+  alloc.makeGrowableAllocator(8);
+  for (size_t i = 0; i < 64; ++i) {
+    ASSERT_TRUE(alloc.alloc(4) != nullptr);
+  }
+  size_t chunks = alloc.chunkCount();
+  size_t capacity = alloc.capacity();
+  size_t peak = alloc.used();
+
+  for (size_t round = 0; round < 10; ++round) {
+    alloc.reset();
+    ASSERT_EQ(alloc.used(), 0);
+    for (size_t i = 0; i < 64; ++i) {
+      ASSERT_TRUE(alloc.alloc(4) != nullptr);
+    }
+  }
+  ASSERT_EQ(alloc.chunkCount(), chunks);
+  ASSERT_EQ(alloc.capacity(), capacity);
+  ASSERT_EQ(alloc.highWaterMark(), peak);
+}
+
+TEST(TestGrowable, HighWaterMark) {
+  Allocator alloc;
+  alloc.makeAllocator(100);
+  ASSERT_TRUE(alloc.alloc(70) != nullptr);
+  alloc.reset();
+  ASSERT_TRUE(alloc.alloc(20) != nullptr);
+  ASSERT_EQ(alloc.used(), 20);
+  ASSERT_EQ(alloc.highWaterMark(), 70);
+  ASSERT_TRUE(alloc.alloc(81) == nullptr);
+  ASSERT_EQ(alloc.chunkCount(), 1);
+}
+#endif  // TEST_6
+
+#ifdef TEST_7
+TEST(TestMarker, Rewind) {
+  Allocator alloc;
+  alloc.makeAllocator(100);
+  char* first = alloc.alloc(10);
+  ASSERT_TRUE(first != nullptr);
+
+  Allocator::Marker marker = alloc.mark();
+  char* scratch = alloc.alloc(90);
+  ASSERT_TRUE(scratch != nullptr);
+  ASSERT_TRUE(alloc.alloc(1) == nullptr);
+
+  alloc.rewind(marker);
+  ASSERT_EQ(alloc.used(), 10);
+  ASSERT_EQ(alloc.highWaterMark(), 100);
+  ASSERT_EQ(alloc.alloc(90), scratch);
+}
+
+TEST(TestMarker, NestedScopes) {
+  Allocator alloc;
+  alloc.makeGrowableAllocator(32);
+  ASSERT_TRUE(alloc.alloc(8) != nullptr);
+  {
+    ArenaScope outer(alloc);
+    ASSERT_TRUE(alloc.alloc(16) != nullptr);
+    {
+      ArenaScope inner(alloc);
+      for (size_t i = 0; i < 10; ++i) {
+        ASSERT_TRUE(alloc.alloc(32) != nullptr);
+      }
+      ASSERT_GT(alloc.chunkCount(), 1);
+    }
+    ASSERT_EQ(alloc.used(), 24);
+  }
+  ASSERT_EQ(alloc.used(), 8);
+
+  size_t chunks = alloc.chunkCount();
+  {
+    ArenaScope scope(alloc);
+    for (size_t i = 0; i < 10; ++i) {
+      ASSERT_TRUE(alloc.alloc(32) != nullptr);
+    }
+  }
+  ASSERT_EQ(alloc.chunkCount(), chunks);
+}
+
+TEST(TestMarker, EmptyAllocator) {
+  Allocator alloc;
+  alloc.rewind(alloc.mark());
+  ASSERT_TRUE(alloc.alloc(1) == nullptr);
+}
+#endif  // TEST_7
+
+#ifdef TEST_8
+TEST(TestResource, PmrContainers) {
+  Allocator alloc;
+  alloc.makeGrowableAllocator(64);
+  ArenaResource resource(alloc);
+  {
+    std::pmr::vector<uint64_t> values(&resource);
+    std::pmr::map<int, std::pmr::string> names(&resource);
+    for (int i = 0; i < 100; ++i) {
+      values.push_back(i);
+      names.emplace(i, std::pmr::string(40, 'x', &resource));
+    }
+    ASSERT_EQ(values.size(), 100);
+    ASSERT_EQ(values[99], 99);
+    ASSERT_EQ(std::string_view(names[42]), std::string(40, 'x'));
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(values.data()) % alignof(uint64_t),
+              0);
+  }
+  ASSERT_GE(alloc.used(), 100 * sizeof(uint64_t));
+  ASSERT_TRUE(resource == resource);
+  ASSERT_TRUE(resource != *std::pmr::new_delete_resource());
+}
+
+TEST(TestResource, ExhaustedArenaThrows) {
+  Allocator alloc;
+  alloc.makeAllocator(16);
+  ArenaResource resource(alloc);
+  std::pmr::vector<char> bytes(&resource);
+  ASSERT_THROW(bytes.resize(17), std::bad_alloc);
+}
+#endif  // TEST_8
+
+#ifdef TEST_9
+TEST(TestPool, FixedPoolReuse) {
+  FixedPool pool(24, 4);
+  ASSERT_EQ(pool.blockSize() % alignof(std::max_align_t), 0);
+
+  void* blocks[8];
+  for (void*& block : blocks) {
+    block = pool.allocate();
+    ASSERT_TRUE(block != nullptr);
+  }
+  ASSERT_EQ(pool.slabCount(), 2);
+
+  pool.deallocate(blocks[3]);
+  ASSERT_EQ(pool.allocate(), blocks[3]);
+  for (void* block : blocks) {
+    pool.deallocate(block);
+  }
+  for (size_t i = 0; i < 8; ++i) {
+    pool.allocate();
+  }
+  ASSERT_EQ(pool.slabCount(), 2);
+}
+
+TEST(TestPool, SizeClasses) {
+  SizeClassPool pool;
+  void* small = pool.allocate(10, 8);
+  void* medium = pool.allocate(100, 8);
+  void* large = pool.allocate(1000, 8);
+  void* aligned = pool.allocate(64, 64);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(aligned) % 64, 0);
+
+  pool.deallocate(small, 10, 8);
+  ASSERT_EQ(pool.allocate(16, 8), small);
+  pool.deallocate(medium, 100, 8);
+  pool.deallocate(large, 1000, 8);
+  pool.deallocate(aligned, 64, 64);
+}
+
+TEST(TestPool, StlContainers) {
+  SizeClassPool pool;
+  {
+    std::list<int, PoolAllocator<int>> values{PoolAllocator<int>(pool)};
+    std::map<int, int, std::less<int>,
+             PoolAllocator<std::pair<const int, int>>>
+        squares;
+    for (int i = 0; i < 1000; ++i) {
+      values.push_back(i);
+      squares[i] = i * i;
+    }
+    for (int i = 0; i < 500; ++i) {
+      values.pop_front();
+      squares.erase(i);
+    }
+    ASSERT_EQ(values.front(), 500);
+    ASSERT_EQ(squares.size(), 500);
+    ASSERT_EQ(squares[999], 999 * 999);
+  }
+  ASSERT_TRUE(PoolAllocator<int>(pool) == PoolAllocator<double>(pool));
+  ASSERT_TRUE(PoolAllocator<int>() != PoolAllocator<int>(pool));
+  ASSERT_THROW(PoolAllocator<double>(pool).allocate(SIZE_MAX / 4),
+               std::bad_array_new_length);
+}
+
+TEST(TestPool, DefaultPoolAcrossThreads) {
+  constexpr int kThreads = 4;
+  constexpr int kKeys = 20000;
+  std::vector<size_t> sizes(kThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&sizes, t] {
+      std::map<int, int, std::less<int>,
+               PoolAllocator<std::pair<const int, int>>>
+          values;
+      for (int i = 0; i < kKeys; ++i) {
+        values[i] = i + t;
+      }
+      for (int i = 0; i < kKeys; i += 2) {
+        values.erase(i);
+      }
+      sizes[t] = values.size();
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (size_t size : sizes) {
+    ASSERT_EQ(size, kKeys / 2);
+  }
+}
+#endif  // TEST_9
+
+#ifdef TEST_10
+TEST(TestConcurrent, DisjointBlocks) {
+  constexpr size_t kThreads = 4;
+  constexpr size_t kAllocs = 1000;
+
+  ConcurrentAllocator alloc;
+  alloc.makeAllocator(kThreads * kAllocs * 8);
+  std::vector<std::vector<char*>> blocks(kThreads);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&alloc, &blocks, t] {
+      for (size_t i = 0; i < kAllocs; ++i) {
+        blocks[t].push_back(i % 2 == 0 ? alloc.alloc(8) : alloc.alloc(8, 8));
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  std::set<char*> unique;
+  for (const std::vector<char*>& local : blocks) {
+    for (char* block : local) {
+      ASSERT_TRUE(block != nullptr);
+      unique.insert(block);
+    }
+  }
+  ASSERT_EQ(unique.size(), kThreads * kAllocs);
+  ASSERT_TRUE(alloc.alloc(1) == nullptr);
+  ASSERT_EQ(alloc.used(), kThreads * kAllocs * 8);
+
+  alloc.reset();
+  ASSERT_EQ(alloc.used(), 0);
+  ASSERT_TRUE(alloc.alloc(kThreads * kAllocs * 8) != nullptr);
+}
+
+TEST(TestConcurrent, FailedRequestsLeaveOffset) {
+  ConcurrentAllocator alloc;
+  alloc.makeAllocator(64);
+  char* first = alloc.alloc(32);
+  ASSERT_TRUE(first != nullptr);
+  // A size that would wrap the offset must not hand out the first block.
+  ASSERT_TRUE(alloc.alloc(SIZE_MAX) == nullptr);
+  char* second = alloc.alloc(16);
+  ASSERT_EQ(second, first + 32);
+  ASSERT_TRUE(alloc.alloc(100) == nullptr);
+  ASSERT_TRUE(alloc.alloc(SIZE_MAX, 8) == nullptr);
+  ASSERT_EQ(alloc.used(), 48);
+  ASSERT_TRUE(alloc.alloc(8) != nullptr);
+  ASSERT_TRUE(alloc.alloc(8, 8) != nullptr);
+  ASSERT_TRUE(alloc.alloc(1) == nullptr);
+}
+
+TEST(TestConcurrent, RegistryPerThreadArenas) {
+  ArenaRegistry registry(64);
+  Allocator& main = registry.local();
+  ASSERT_EQ(&main, &registry.local());
+  ASSERT_TRUE(main.alloc(32) != nullptr);
+
+  Allocator* other = nullptr;
+  std::thread([&registry, &other] {
+    other = &registry.local();
+    other->alloc(16);
+  }).join();
+  ASSERT_NE(other, &main);
+  ASSERT_EQ(registry.arenaCount(), 2);
+
+  ASSERT_EQ(main.used(), 32);
+  registry.advanceEpoch();
+  ASSERT_EQ(registry.epoch(), 1);
+  ASSERT_EQ(main.used(), 32);
+  ASSERT_EQ(registry.local().used(), 0);
+  ASSERT_EQ(other->used(), 16);
+}
+
+TEST(TestConcurrent, RegistryRecyclesExitedThreads) {
+  ArenaRegistry registry(64);
+  Allocator* first = nullptr;
+  std::thread([&registry, &first] {
+    first = &registry.local();
+    first->alloc(16);
+  }).join();
+  // The next thread takes over the arena as it is within the epoch.
+  for (int i = 0; i < 100; ++i) {
+    Allocator* arena = nullptr;
+    std::thread([&registry, &arena] { arena = &registry.local(); }).join();
+    ASSERT_EQ(arena, first);
+    ASSERT_EQ(arena->used(), 16);
+  }
+  ASSERT_EQ(registry.arenaCount(), 1);
+  registry.advanceEpoch();
+  std::thread([&registry] {
+    ASSERT_EQ(registry.local().used(), 0);
+  }).join();
+
+  // A thread may outlive a registry it used, whichever thread destroys it.
+  auto doomed = std::make_unique<ArenaRegistry>(64);
+  std::atomic<int> stage = 0;
+  std::thread survivor([&doomed, &stage] {
+    doomed->local().alloc(8);
+    stage = 1;
+    while (stage != 2) {
+      std::this_thread::yield();
+    }
+    ArenaRegistry own(64);
+    own.local().alloc(8);
+  });
+  while (stage != 1) {
+    std::this_thread::yield();
+  }
+  doomed.reset();
+  stage = 2;
+  survivor.join();
+  ASSERT_EQ(registry.arenaCount(), 1);
+}
+#endif  // TEST_10
+
+#ifdef TEST_11
+TEST(TestBacking, Mmap) {
+  Allocator alloc;
+  alloc.makeAllocator(100, Allocator::Backing::kMmap);
+  ASSERT_EQ(alloc.backing(), Allocator::Backing::kMmap);
+  char* block = alloc.alloc(100);
+  ASSERT_TRUE(block != nullptr);
+  block[0] = 1;
+  block[99] = 2;
+  ASSERT_TRUE(alloc.alloc(1) == nullptr);
+  alloc.makeAllocator(10);
+  ASSERT_EQ(alloc.backing(), Allocator::Backing::kHeap);
+}
+
+TEST(TestBacking, LazyCommitLargeArena) {
+  // Far more than the pages touched below, but small enough for memory
+  // limited machines; strict overcommit may still refuse it.
+  Allocator alloc;
+  try {
+    alloc.makeAllocator(size_t(4) << 30, Allocator::Backing::kMmap);
+  } catch (const std::bad_alloc&) {
+    GTEST_SKIP() << "the kernel refused a 4 GiB MAP_NORESERVE mapping";
+  }
+  char* block = alloc.alloc(size_t(1) << 20, 4096);
+  ASSERT_TRUE(block != nullptr);
+  block[0] = 1;
+  char* last = alloc.alloc((size_t(4) << 30) - (size_t(2) << 20));
+  ASSERT_TRUE(last != nullptr);
+  last[0] = 2;
+}
+
+TEST(TestBacking, HugePagesFallBack) {
+  Allocator alloc;
+  alloc.makeGrowableAllocator(1000, Allocator::Backing::kHugePages);
+  ASSERT_NE(alloc.backing(), Allocator::Backing::kHeap);
+  char* block = alloc.alloc(1000);
+  ASSERT_TRUE(block != nullptr);
+  block[999] = 1;
+  ASSERT_TRUE(alloc.alloc(5000, 64) != nullptr);
+  ASSERT_EQ(alloc.chunkCount(), 2);
+}
+#endif  // TEST_11
+
+#ifdef TEST_12
+#ifdef ALLOCATOR_STATS
+TEST(TestStats, Counters) {
+  Allocator alloc;
+  alloc.makeAllocator(100);
+  ASSERT_TRUE(alloc.alloc(1) != nullptr);
+  ASSERT_TRUE(alloc.alloc(40, 8) != nullptr);
+  ASSERT_TRUE(alloc.alloc(100) == nullptr);
+  alloc.reset();
+  ASSERT_TRUE(alloc.alloc(0) != nullptr);
+
+  AllocatorStats stats = alloc.stats();
+  ASSERT_EQ(stats.allocations, 3);
+  ASSERT_EQ(stats.failedAllocations, 1);
+  ASSERT_EQ(stats.bytesAllocated, 41);
+  ASSERT_EQ(stats.resets, 1);
+  ASSERT_EQ(stats.peakUsage, 48);
+  ASSERT_EQ(stats.histogram[0], 1);
+  ASSERT_EQ(stats.histogram[1], 1);
+  ASSERT_EQ(stats.histogram[AllocatorStats::sizeClass(40)], 1);
+  ASSERT_EQ(AllocatorStats::sizeClass(size_t(1) << 40),
+            AllocatorStats::kSizeClasses - 1);
+
+  std::string json = stats.toJson();
+  ASSERT_NE(json.find("\"allocations\": 3"), std::string::npos);
+  ASSERT_NE(json.find("\"histogram\": [1, 1, 0, 0, 0, 0, 1,"),
+            std::string::npos);
+}
+#else
+// With statistics compiled out the counters must not occupy any space.
+static_assert(std::is_empty_v<NullAllocatorStats>);
+#endif  // ALLOCATOR_STATS
+#endif  // TEST_12
+
 int main(int argc, char *argv[]) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
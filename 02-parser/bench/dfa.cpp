@@ -0,0 +1,87 @@
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "bench.hpp"
+#include "grammar.hpp"
+#include "parser.hpp"
+
+namespace {
+
+constexpr size_t kInputBytes = size_t(64) << 20;
+constexpr size_t kRepeats = 3;
+
+std::string MakeInput() {
+  std::mt19937_64 random(42);
+  std::string input;
+  input.reserve(kInputBytes + 64);
+  while (input.size() < kInputBytes) {
+    switch (random() % 5) {
+      case 0:
+        input += std::to_string(random() % 100000);
+        break;
+      case 1:
+        input += "-" + std::to_string(random() % 1000);
+        break;
+      case 2:
+        input += "0x" + std::to_string(random() % 0xffff);
+        break;
+      case 3:
+        input += std::to_string(random() % 1000) + ".5";
+        break;
+      default:
+        input += "field_" + std::to_string(random() % 100);
+        break;
+    }
+    input += random() % 8 == 0 ? '\n' : ' ';
+  }
+  return input;
+}
+
+void Report(const char* name, double ns) {
+  std::cout << std::left << std::setw(32) << name << std::fixed
+            << std::setprecision(1) << kInputBytes / ns * 1e9 / (1 << 20)
+            << " MB/s\n";
+}
+
+}  // namespace
+
+int main() {
+  std::string input = MakeInput();
+  uint64_t counted = 0;
+  auto count = [&counted](std::string_view) { ++counted; };
+
+  TokenParser builtin;
+  builtin.SetDigitTokenCallback([&counted](uint64_t) { ++counted; });
+  builtin.SetStringTokenViewCallback(count);
+  Report("built-in digit/string split",
+         bench::BestOf(kRepeats, [&] { builtin.Parse(input); }));
+
+  TokenGrammar two_types;
+  auto digit = two_types.AddToken("digit", "0|[1-9][0-9]*");
+  TokenParser simple;
+  simple.SetGrammar(two_types);
+  simple.SetDigitTokenType(digit);
+  simple.SetDigitTokenCallback([&counted](uint64_t) { ++counted; });
+  simple.SetStringTokenViewCallback(count);
+  Report("DFA, digit/string grammar",
+         bench::BestOf(kRepeats, [&] { simple.Parse(input); }));
+
+  TokenGrammar rich;
+  TokenParser full;
+  for (auto [name, pattern] :
+       {std::pair{"hex", "0[xX][0-9a-fA-F]+"},
+        std::pair{"int", "[+-]?(0|[1-9][0-9]*)"},
+        std::pair{"float", "[+-]?[0-9]+\\.[0-9]*([eE][+-]?[0-9]+)?"},
+        std::pair{"ident", "[a-zA-Z_][a-zA-Z0-9_]*"}}) {
+    full.SetTokenCallback(rich.AddToken(name, pattern), count);
+  }
+  full.SetGrammar(rich);
+  full.SetStringTokenViewCallback(count);
+  Report("DFA, four token types",
+         bench::BestOf(kRepeats, [&] { full.Parse(input); }));
+
+  bench::DoNotOptimize(counted);
+}
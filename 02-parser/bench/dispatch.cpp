@@ -0,0 +1,72 @@
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+
+#include "basic_parser.hpp"
+#include "bench.hpp"
+#include "parser.hpp"
+
+namespace {
+
+constexpr size_t kInputBytes = size_t(64) << 20;
+constexpr size_t kRepeats = 5;
+
+// Short tokens make the per-token dispatch cost dominate.
+std::string MakeInput() {
+  std::mt19937_64 random(42);
+  std::string input;
+  input.reserve(kInputBytes + 16);
+  while (input.size() < kInputBytes) {
+    input += random() % 2 == 0 ? std::to_string(random() % 100) : "ab";
+    input += ' ';
+  }
+  return input;
+}
+
+void Report(const char* name, double ns) {
+  std::cout << std::left << std::setw(28) << name << std::fixed
+            << std::setprecision(1) << kInputBytes / ns * 1e9 / (1 << 20)
+            << " MB/s\n";
+}
+
+}  // namespace
+
+int main() {
+  std::string input = MakeInput();
+  uint64_t digits = 0;
+  uint64_t strings = 0;
+
+  TokenParser dynamic;
+  dynamic.SetDigitTokenCallback([&digits](uint64_t) { ++digits; });
+  dynamic.SetStringTokenViewCallback([&strings](std::string_view) {
+    ++strings;
+  });
+  Report("TokenParser (std::function)",
+         bench::BestOf(kRepeats, [&] { dynamic.Parse(input); }));
+
+  BasicTokenParser fixed([&digits](uint64_t) { ++digits; },
+                         [&strings](std::string_view) { ++strings; });
+  Report("BasicTokenParser",
+         bench::BestOf(kRepeats, [&] { fixed.Parse(input); }));
+
+  // Summing digit tokens: once per token versus once per batch, where the
+  // consumer's loop over a contiguous array can be vectorized.
+  uint64_t sum = 0;
+  TokenParser per_token;
+  per_token.SetDigitTokenCallback([&sum](uint64_t num) { sum += num; });
+  Report("sum, per-token callback",
+         bench::BestOf(kRepeats, [&] { per_token.Parse(input); }));
+
+  TokenParser batched;
+  batched.SetDigitBatchCallback(
+      [&sum](std::span<const uint64_t> nums, std::span<const size_t>) {
+        sum = std::accumulate(nums.begin(), nums.end(), sum);
+      });
+  Report("sum, batch callback",
+         bench::BestOf(kRepeats, [&] { batched.Parse(input); }));
+
+  bench::DoNotOptimize(digits + strings + sum);
+}
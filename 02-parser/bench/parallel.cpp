@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "bench.hpp"
+#include "parser.hpp"
+
+namespace {
+
+constexpr size_t kInputBytes = size_t(256) << 20;
+constexpr size_t kRepeats = 3;
+constexpr size_t kCounterSlots = 64;
+
+std::string MakeInput() {
+  std::mt19937_64 random(42);
+  std::string input;
+  input.reserve(kInputBytes + 64);
+  while (input.size() < kInputBytes) {
+    input += random() % 2 == 0 ? std::to_string(random() % 100000)
+                               : "user" + std::to_string(random() % 1000);
+    input += random() % 8 == 0 ? '\n' : ' ';
+  }
+  return input;
+}
+
+// Counters spread over cache lines so that concurrent workers rarely touch
+// the same one.
+struct alignas(64) Counter {
+  std::atomic<uint64_t> value{0};
+};
+
+Counter& LocalCounter(Counter* counters) {
+  size_t slot = std::hash<std::thread::id>()(std::this_thread::get_id());
+  return counters[slot % kCounterSlots];
+}
+
+}  // namespace
+
+int main() {
+  std::string input = MakeInput();
+  Counter counters[kCounterSlots];
+
+  TokenParser parser;
+  parser.SetDigitTokenCallback([&counters](uint64_t num) {
+    LocalCounter(counters).value.fetch_add(num, std::memory_order_relaxed);
+  });
+  parser.SetStringTokenViewCallback([&counters](std::string_view str) {
+    LocalCounter(counters).value.fetch_add(str.size(),
+                                           std::memory_order_relaxed);
+  });
+
+  double serial = bench::BestOf(kRepeats, [&] { parser.Parse(input); });
+  std::cout << std::left << std::setw(12) << "threads" << std::setw(22)
+            << "ordered MB/s" << "unordered MB/s\n";
+  size_t max_threads =
+      std::max<size_t>(std::thread::hardware_concurrency(), 4);
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    double ordered = bench::BestOf(kRepeats, [&] {
+      parser.ParseParallel(input, threads, TokenParser::Delivery::kOrdered);
+    });
+    double unordered = bench::BestOf(kRepeats, [&] {
+      parser.ParseParallel(input, threads, TokenParser::Delivery::kUnordered);
+    });
+    std::cout << std::left << std::setw(12) << threads << std::fixed
+              << std::setprecision(1) << std::setw(22)
+              << kInputBytes / ordered * 1e9 / (1 << 20)
+              << kInputBytes / unordered * 1e9 / (1 << 20) << '\n';
+  }
+  std::cout << "serial Parse: " << kInputBytes / serial * 1e9 / (1 << 20)
+            << " MB/s\n";
+
+  uint64_t total = 0;
+  for (Counter& counter : counters) {
+    total += counter.value;
+  }
+  bench::DoNotOptimize(total);
+}
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <iomanip>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "bench.hpp"
+#include "parser.hpp"
+#include "tokenizer.hpp"
+
+namespace {
+
+constexpr size_t kInputBytes = size_t(64) << 20;
+constexpr size_t kRepeats = 3;
+
+// Log-like mix of numbers, identifiers and numbers with leading zeros.
+std::string MakeInput() {
+  std::mt19937_64 random(42);
+  std::string input;
+  input.reserve(kInputBytes + 64);
+  while (input.size() < kInputBytes) {
+    switch (random() % 4) {
+      case 0:
+        input += std::to_string(random() % 100000);
+        break;
+      case 1:
+        input += std::to_string(random());
+        break;
+      case 2:
+        input += "request_id=" + std::to_string(random() % 1000);
+        break;
+      default:
+        input += "GET";
+        break;
+    }
+    input += random() % 8 == 0 ? '\n' : ' ';
+  }
+  return input;
+}
+
+// The stringstream parser TokenParser::Parse used to be, kept as the
+// baseline.
+void LegacyParse(const std::string& string, uint64_t& digits,
+                 uint64_t& strings) {
+  std::stringstream ss(string);
+  std::string token;
+  while (ss >> token) {
+    if ((token[0] != '0' || token.size() == 1) &&
+        std::all_of(token.begin(), token.end(), [](unsigned char symbol) {
+          return std::isdigit(symbol) != 0;
+        })) {
+      try {
+        digits += std::stoull(token);
+      } catch (const std::exception&) {
+        strings += token.size();
+      }
+    } else {
+      strings += token.size();
+    }
+  }
+}
+
+void Report(const char* name, double ns) {
+  std::cout << std::left << std::setw(32) << name << std::fixed
+            << std::setprecision(1) << kInputBytes / ns * 1e9 / (1 << 20)
+            << " MB/s\n";
+}
+
+}  // namespace
+
+int main() {
+  std::string input = MakeInput();
+  uint64_t digits = 0;
+  uint64_t strings = 0;
+
+  Report("stringstream (legacy)", bench::BestOf(kRepeats, [&] {
+           LegacyParse(input, digits, strings);
+         }));
+
+  TokenParser copying;
+  copying.SetDigitTokenCallback([&](uint64_t num) { digits += num; });
+  copying.SetStringTokenCallback(
+      [&](const std::string& str) { strings += str.size(); });
+  Report("Parse, std::string tokens",
+         bench::BestOf(kRepeats, [&] { copying.Parse(input); }));
+
+  TokenParser viewing;
+  viewing.SetDigitTokenCallback([&](uint64_t num) { digits += num; });
+  viewing.SetStringTokenViewCallback(
+      [&](std::string_view str) { strings += str.size(); });
+  Report("Parse, std::string_view tokens",
+         bench::BestOf(kRepeats, [&] { viewing.Parse(input); }));
+
+  std::istringstream stream(input);
+  Report("ParseStream, string_view", bench::BestOf(kRepeats, [&] {
+           stream.clear();
+           stream.seekg(0);
+           viewing.ParseStream(stream);
+         }));
+
+  std::string path = "bench_throughput.txt";
+  std::ofstream(path, std::ios::binary) << input;
+  Report("ParseFile (mmap), string_view",
+         bench::BestOf(kRepeats, [&] { viewing.ParseFile(path); }));
+  std::remove(path.c_str());
+
+  // Boundary detection alone, per classification kernel.
+  const char* names[] = {"tokenize, scalar", "tokenize, SSE2",
+                         "tokenize, AVX2"};
+  for (auto kernel : {tokenizer::Kernel::kScalar, tokenizer::Kernel::kSse2,
+                      tokenizer::Kernel::kAvx2}) {
+    if (!tokenizer::IsSupported(kernel)) {
+      continue;
+    }
+    auto classify = tokenizer::Classifier(kernel);
+    Report(names[static_cast<int>(kernel)], bench::BestOf(kRepeats, [&] {
+             tokenizer::ForEachToken(
+                 input, classify, [&](std::string_view token, bool all_digits) {
+                   strings += token.size() + all_digits;
+                 });
+           }));
+  }
+
+  bench::DoNotOptimize(digits + strings);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+#include "tokenizer.hpp"
+
+// Placeholder for the BasicTokenParser events the caller ignores.
+struct NoCallback {
+  template <class... Args>
+  void operator()(Args&&...) const {}
+};
+
+// TokenParser with its callbacks fixed at compile time. The handlers are
+// stored by value and called directly, so lambdas inline into the scan
+// loop instead of going through std::function. String tokens are views
+// into the parsed buffer.
+template <class OnDigit = NoCallback, class OnString = NoCallback,
+          class OnStart = NoCallback, class OnEnd = NoCallback>
+class BasicTokenParser {
+ public:
+  explicit BasicTokenParser(OnDigit on_digit = {}, OnString on_string = {},
+                            OnStart on_start = {}, OnEnd on_end = {})
+      : on_digit_(std::move(on_digit)),
+        on_string_(std::move(on_string)),
+        on_start_(std::move(on_start)),
+        on_end_(std::move(on_end)) {}
+
+  void Parse(std::string_view string) {
+    on_start_();
+    tokenizer::ForEachToken(string, [this](std::string_view token,
+                                           bool all_digits) {
+      uint64_t num;
+      if (tokenizer::ParseNumber(token, all_digits, num)) {
+        on_digit_(num);
+      } else {
+        on_string_(token);
+      }
+    });
+    on_end_();
+  }
+
+ private:
+  [[no_unique_address]] OnDigit on_digit_;
+  [[no_unique_address]] OnString on_string_;
+  [[no_unique_address]] OnStart on_start_;
+  [[no_unique_address]] OnEnd on_end_;
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "tokenizer.hpp"
+
+// Token classes described by patterns and compiled into one table-driven
+// DFA. Token boundaries come from the block tokenizer, so the DFA only
+// walks the bytes of each token, one table load per byte.
+//
+// Patterns use a small regular-expression subset: literal bytes, "\"
+// escapes ("\d" digits, "\w" word bytes, anything else literally), "." for
+// any byte, classes "[a-f0-9]" and "[^...]", grouping "(...)", alternation
+// "|" and the quantifiers "*", "+" and "?". Tokens are still separated by
+// whitespace, which patterns therefore never match. A token gets the type
+// of the first registered pattern matching all of it, or kUnmatched.
+class TokenGrammar {
+ public:
+  using TokenType = size_t;
+  static constexpr TokenType kUnmatched = SIZE_MAX;
+
+  // Throws std::invalid_argument on a malformed pattern.
+  TokenType AddToken(std::string name, std::string_view pattern);
+  // Builds the DFA; throws std::length_error if it grows past kMaxStates.
+  void Compile();
+
+  bool compiled() const;
+  size_t size() const;
+  const std::string& name(TokenType type) const;
+  size_t stateCount() const;
+
+  // Type of one token, which must be non-empty and contain no whitespace;
+  // requires compiled(). all_digits, as the block tokenizer reports it,
+  // lets grammars of decimals alone skip the DFA.
+  TokenType Classify(std::string_view token, bool all_digits = false) const {
+    if (decimals_only_) {
+      return all_digits ? decimal_types_[token[0] - '0'][token.size() > 1]
+                        : kUnmatched;
+    }
+    const uint16_t* classes = classes_.data();
+    const uint32_t* transitions = transitions_.data();
+    uint32_t row = kStartState;
+    for (char symbol : token) {
+      row = transitions[row + classes[static_cast<unsigned char>(symbol)]];
+    }
+    return accept_[row >> row_shift_];
+  }
+
+  // Calls handler(token, type) for every whitespace separated token of
+  // text; requires compiled().
+  template <class Handler>
+  void ForEachToken(std::string_view text, Handler&& handler) const {
+    tokenizer::ForEachToken(text, [&](std::string_view token,
+                                      bool all_digits) {
+      handler(token, Classify(token, all_digits));
+    });
+  }
+
+  static constexpr size_t kMaxStates = 1 << 16;
+
+ private:
+  static constexpr uint32_t kStartState = 0;
+  static constexpr uint16_t kSpaceClass = 0;
+
+  // dead_row is the row of the empty state, or UINT32_MAX if there is none.
+  void DecideDecimals(uint32_t dead_row);
+
+  std::vector<std::string> names_;
+  std::vector<std::string> patterns_;
+  bool compiled_ = false;
+
+  // Bytes that no pattern tells apart share a class; whitespace is class 0.
+  std::vector<uint16_t> classes_;
+  size_t class_count_ = 0;
+  // Rows are padded to 1 << row_shift_ entries and transitions hold the
+  // offset of the target row, so a step is one add and one load.
+  size_t row_shift_ = 0;
+  std::vector<uint32_t> transitions_;
+  std::vector<TokenType> accept_;
+  // Set when only decimal tokens can match and the type of each follows
+  // from its first digit and whether more digits follow; then
+  // decimal_types_[first][longer] holds it and Classify skips the DFA.
+  bool decimals_only_ = false;
+  std::array<std::array<TokenType, 2>, 10> decimal_types_ = {};
+};
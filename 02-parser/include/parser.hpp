@@ -1,27 +1,138 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <functional>
+#include <istream>
+#include <span>
 #include <string>
+#include <string_view>
+#include <vector>
+
+#include "grammar.hpp"
+#include "tokenizer.hpp"
 
 class TokenParser {
  public:
   using StringCallBack = std::function<void(const std::string&)>;
+  // Receives a view into the parsed buffer; it is only valid during the
+  // call, so copy it if the token has to outlive the callback.
+  using StringViewCallBack = std::function<void(std::string_view)>;
   using DigitCallBack = std::function<void(uint64_t)>;
   using CallBack = std::function<void()>;
+  using TokenCallBack = std::function<void(std::string_view)>;
+  // Batches carry up to kBatchSize tokens of one kind in input order, with
+  // the byte offset of each token from the start of the input. The spans
+  // are only valid during the call.
+  using DigitBatchCallBack = std::function<void(
+      std::span<const uint64_t> nums, std::span<const size_t> positions)>;
+  using StringBatchCallBack =
+      std::function<void(std::span<const std::string_view> strs,
+                         std::span<const size_t> positions)>;
+
+  static constexpr size_t kStreamBlockSize = size_t(1) << 16;
+  static constexpr size_t kBatchSize = 256;
 
-  TokenParser() = default;
+  enum class Delivery {
+    // Callbacks run on the calling thread in input order; workers tokenize
+    // ahead and a reorder buffer hands their chunks back in sequence.
+    kOrdered,
+    // Callbacks run concurrently on the worker threads in no particular
+    // order, so they must be thread-safe. Suits commutative aggregation.
+    kUnordered,
+  };
+
+  // Starts with the built-in grammar: canonical decimals (no leading
+  // zeros) as the digit type, everything else unmatched, i.e. a string.
+  TokenParser();
 
   void SetStartCallback(CallBack function);
   void SetEndCallback(CallBack function);
   void SetDigitTokenCallback(DigitCallBack function);
   void SetStringTokenCallback(StringCallBack function);
+  void SetStringTokenViewCallback(StringViewCallBack function);
+  // Batch callbacks are opt-in and fire alongside the per-token ones. A
+  // batch is handed over when it is full and at the end of every scanned
+  // buffer, so always before the end callback.
+  void SetDigitBatchCallback(DigitBatchCallBack function);
+  void SetStringBatchCallback(StringBatchCallBack function);
+  // Classifies tokens with the DFA of grammar (compiled here if needed)
+  // instead of the built-in one, and clears the digit type. Each token goes
+  // to the callback registered for its type; unmatched tokens go to the
+  // string callbacks and string batches. ClearGrammar restores the
+  // built-in grammar and its digit type.
+  void SetGrammar(TokenGrammar grammar);
+  void ClearGrammar();
+  void SetTokenCallback(TokenGrammar::TokenType type, TokenCallBack function);
+  // Tokens of type are converted to uint64_t and go to the digit callbacks
+  // and digit batches; those that are not all decimal digits or do not fit
+  // go to the string ones. kUnmatched turns this off.
+  void SetDigitTokenType(TokenGrammar::TokenType type);
 
-  void Parse(const std::string& string) const;
+  void Parse(std::string_view string) const;
+  // Parse the whole stream or file as a single input: start and end fire
+  // once and tokens may straddle read boundaries. ParseStream reads blocks
+  // of kStreamBlockSize bytes; ParseFile maps a regular file into memory,
+  // streams pipes and special files, and throws std::runtime_error if the
+  // path cannot be opened.
+  void ParseStream(std::istream& stream) const;
+  void ParseFile(const std::string& path) const;
+  // Splits the input at whitespace into chunks and tokenizes them on
+  // threads workers (0 means one per core). Start and end fire once on the
+  // calling thread. Small inputs fall back to Parse.
+  void ParseParallel(std::string_view string, size_t threads,
+                     Delivery delivery = Delivery::kOrdered) const;
 
  private:
   CallBack startcallback_ = nullptr, endcallback_ = nullptr;
   StringCallBack stringcallback_ = nullptr;
+  StringViewCallBack stringviewcallback_ = nullptr;
   DigitCallBack digitcallback_ = nullptr;
+  DigitBatchCallBack digitbatchcallback_ = nullptr;
+  StringBatchCallBack stringbatchcallback_ = nullptr;
+  TokenGrammar grammar_;
+  std::vector<TokenCallBack> tokencallbacks_;
+  TokenGrammar::TokenType digittype_;
+
+  struct TokenBatch {
+    std::array<uint64_t, kBatchSize> nums;
+    std::array<size_t, kBatchSize> num_positions;
+    size_t num_count = 0;
+    std::array<std::string_view, kBatchSize> strs;
+    std::array<size_t, kBatchSize> str_positions;
+    size_t str_count = 0;
+  };
+
+  bool Batching() const {
+    return digitbatchcallback_ != nullptr || stringbatchcallback_ != nullptr;
+  }
+
+  bool PerToken() const {
+    return digitcallback_ != nullptr || stringcallback_ != nullptr ||
+           stringviewcallback_ != nullptr;
+  }
+
+  // offset is the position of string within the whole input.
+  void ScanTokens(std::string_view string, size_t offset = 0) const;
+  void ParseOrdered(const std::vector<std::string_view>& chunks,
+                    size_t threads) const;
+  void ParseUnordered(const std::vector<std::string_view>& chunks,
+                      size_t threads) const;
+  // Passes a token that is neither a number nor a string to the callback
+  // of its type.
+  void HandleToken(std::string_view token, TokenGrammar::TokenType type) const;
+  // Classifies token with the grammar; true when it is of the digit type
+  // and its value fits into num.
+  bool ClassifyToken(std::string_view token, bool all_digits,
+                     TokenGrammar::TokenType& type, uint64_t& num) const {
+    type = grammar_.Classify(token, all_digits);
+    return type != TokenGrammar::kUnmatched && type == digittype_ &&
+           tokenizer::ParseDecimal(token, all_digits, num);
+  }
+  // Whether a token of type that is not a number goes to the strings.
+  bool StringType(TokenGrammar::TokenType type) const {
+    return type == TokenGrammar::kUnmatched || type == digittype_;
+  }
 
   void HandlerToken(uint64_t num) const {
     if (digitcallback_) {
@@ -29,9 +140,21 @@ class TokenParser {
     }
   }
 
-  void HandlerToken(const std::string& str) const {
+  void HandlerToken(std::string_view str) const {
+    if (stringviewcallback_) {
+      stringviewcallback_(str);
+    }
     if (stringcallback_) {
-      stringcallback_(str);
+      stringcallback_(std::string(str));
     }
   }
+
+  void HandlerToken(uint64_t num, size_t position, TokenBatch& batch) const;
+  void HandlerToken(std::string_view str, size_t position,
+                    TokenBatch& batch) const;
+  // Append to the batch only, for tokens nobody wants one at a time.
+  void BatchToken(uint64_t num, size_t position, TokenBatch& batch) const;
+  void BatchToken(std::string_view str, size_t position,
+                  TokenBatch& batch) const;
+  void FlushBatch(TokenBatch& batch) const;
 };
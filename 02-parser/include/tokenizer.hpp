@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <utility>
+
+namespace tokenizer {
+
+constexpr size_t kBlockSize = 64;
+
+// Classification of one 64-byte block: bit i describes byte i.
+struct BlockMasks {
+  uint64_t space;
+  uint64_t digit;
+};
+
+inline bool IsSpace(char symbol) {
+  unsigned char byte = symbol;
+  return byte == ' ' || static_cast<unsigned char>(byte - '\t') <= 4;
+}
+
+// Converts a token of decimal digits that fits into uint64_t.
+inline bool ParseDecimal(std::string_view token, bool all_digits,
+                         uint64_t& num) {
+  if (!all_digits) {
+    return false;
+  }
+  const char* end = token.data() + token.size();
+  auto [ptr, ec] = std::from_chars(token.data(), end, num);
+  return ec == std::errc() && ptr == end;
+}
+
+// A digit token is a canonical decimal (no leading zeros) that fits into
+// uint64_t; anything else, including overflowing numbers, is a string.
+inline bool ParseNumber(std::string_view token, bool all_digits,
+                        uint64_t& num) {
+  if (token.size() > 1 && token[0] == '0') {
+    return false;
+  }
+  return ParseDecimal(token, all_digits, num);
+}
+
+enum class Kernel { kScalar, kSse2, kAvx2 };
+
+using ClassifyFunction = BlockMasks (*)(const char* block);
+
+// Whitespace is what std::isspace accepts in the C locale.
+BlockMasks ClassifyScalar(const char* block);
+BlockMasks ClassifySse2(const char* block);
+BlockMasks ClassifyAvx2(const char* block);
+
+bool IsSupported(Kernel kernel);
+// Widest kernel the running CPU supports.
+Kernel BestKernel();
+ClassifyFunction Classifier(Kernel kernel);
+ClassifyFunction DefaultClassifier();
+
+// Calls handler(token, all_digits) for every whitespace separated token of
+// text, classifying a whole block per call to classify. Token boundaries
+// come from the space mask, so the per-byte work is a few bit operations.
+template <class Handler>
+void ForEachToken(std::string_view text, ClassifyFunction classify,
+                  Handler&& handler) {
+  const char* data = text.data();
+  size_t size = text.size();
+  size_t token_start = 0;
+  size_t start_bit = 0;
+  bool in_token = false;
+  bool token_other = false;
+
+  for (size_t base = 0; base < size; base += kBlockSize) {
+    BlockMasks masks;
+    size_t length = std::min(kBlockSize, size - base);
+    if (length == kBlockSize) {
+      masks = classify(data + base);
+    } else {
+      char tail[kBlockSize];
+      std::memcpy(tail, data + base, length);
+      std::memset(tail + length, ' ', kBlockSize - length);
+      masks = classify(tail);
+    }
+
+    uint64_t nonspace = ~masks.space;
+    uint64_t other = nonspace & ~masks.digit;
+    uint64_t previous = (nonspace << 1) | (in_token ? 1 : 0);
+    uint64_t starts = nonspace & ~previous;
+    uint64_t ends = masks.space & previous;
+
+    for (uint64_t events = starts | ends; events != 0; events &= events - 1) {
+      size_t bit = std::countr_zero(events);
+      uint64_t below = (uint64_t(1) << bit) - 1;
+      if ((starts >> bit) & 1) {
+        token_start = base + bit;
+        start_bit = bit;
+        in_token = true;
+      } else {
+        uint64_t from_start = ~((uint64_t(1) << start_bit) - 1);
+        token_other |= (other & below & from_start) != 0;
+        size_t length = base + bit - token_start;
+        handler(std::string_view(data + token_start, length), !token_other);
+        token_other = false;
+        in_token = false;
+      }
+    }
+
+    if (in_token) {
+      token_other |= (other & ~((uint64_t(1) << start_bit) - 1)) != 0;
+      start_bit = 0;
+    }
+  }
+
+  if (in_token) {
+    handler(std::string_view(data + token_start, size - token_start),
+            !token_other);
+  }
+}
+
+template <class Handler>
+void ForEachToken(std::string_view text, Handler&& handler) {
+  ForEachToken(text, DefaultClassifier(), std::forward<Handler>(handler));
+}
+
+}  // namespace tokenizer
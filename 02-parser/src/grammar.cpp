@@ -0,0 +1,406 @@
+#include "grammar.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <bitset>
+#include <map>
+#include <set>
+#include <stdexcept>
+
+namespace {
+
+using ByteSet = std::bitset<256>;
+
+ByteSet SpaceBytes() {
+  ByteSet set;
+  for (size_t byte = 0; byte < 256; ++byte) {
+    set[byte] = tokenizer::IsSpace(static_cast<char>(byte));
+  }
+  return set;
+}
+
+ByteSet RangeBytes(unsigned char low, unsigned char high) {
+  ByteSet set;
+  for (size_t byte = low; byte <= high; ++byte) {
+    set.set(byte);
+  }
+  return set;
+}
+
+// Thompson automaton: a state either consumes one byte of its set on the
+// edge to next or has only epsilon edges.
+struct Nfa {
+  struct State {
+    ByteSet bytes;
+    int next = -1;
+    std::vector<int> epsilon;
+    TokenGrammar::TokenType accept = TokenGrammar::kUnmatched;
+  };
+
+  int Add() {
+    states.emplace_back();
+    return static_cast<int>(states.size()) - 1;
+  }
+
+  void Link(int from, int to) { states[from].epsilon.push_back(to); }
+
+  std::vector<State> states;
+};
+
+struct Fragment {
+  int start;
+  int end;
+};
+
+class PatternParser {
+ public:
+  PatternParser(std::string_view pattern, Nfa& nfa)
+      : pattern_(pattern), nfa_(nfa) {}
+
+  Fragment Parse() {
+    Fragment fragment = ParseAlternation();
+    if (pos_ != pattern_.size()) {
+      Fail("unbalanced ')'");
+    }
+    return fragment;
+  }
+
+ private:
+  [[noreturn]] void Fail(const std::string& reason) const {
+    throw std::invalid_argument("bad token pattern \"" +
+                                std::string(pattern_) + "\": " + reason);
+  }
+
+  bool Peek(char symbol) const {
+    return pos_ < pattern_.size() && pattern_[pos_] == symbol;
+  }
+
+  Fragment ParseAlternation() {
+    Fragment left = ParseConcat();
+    while (Peek('|')) {
+      ++pos_;
+      Fragment right = ParseConcat();
+      int start = nfa_.Add();
+      int end = nfa_.Add();
+      nfa_.Link(start, left.start);
+      nfa_.Link(start, right.start);
+      nfa_.Link(left.end, end);
+      nfa_.Link(right.end, end);
+      left = {start, end};
+    }
+    return left;
+  }
+
+  Fragment ParseConcat() {
+    int start = nfa_.Add();
+    Fragment result = {start, start};
+    while (pos_ < pattern_.size() && !Peek('|') && !Peek(')')) {
+      Fragment next = ParseRepeat();
+      nfa_.Link(result.end, next.start);
+      result.end = next.end;
+    }
+    return result;
+  }
+
+  Fragment ParseRepeat() {
+    Fragment atom = ParseAtom();
+    while (Peek('*') || Peek('+') || Peek('?')) {
+      char quantifier = pattern_[pos_++];
+      int start = nfa_.Add();
+      int end = nfa_.Add();
+      nfa_.Link(start, atom.start);
+      nfa_.Link(atom.end, end);
+      if (quantifier != '+') {
+        nfa_.Link(start, end);
+      }
+      if (quantifier != '?') {
+        nfa_.Link(atom.end, atom.start);
+      }
+      atom = {start, end};
+    }
+    return atom;
+  }
+
+  Fragment ParseAtom() {
+    char symbol = pattern_[pos_++];
+    switch (symbol) {
+      case '(': {
+        Fragment inner = ParseAlternation();
+        if (!Peek(')')) {
+          Fail("missing ')'");
+        }
+        ++pos_;
+        return inner;
+      }
+      case '*':
+      case '+':
+      case '?':
+        Fail("nothing to repeat");
+      case '[':
+        return Edge(ParseClass());
+      case '.':
+        return Edge(ByteSet().set());
+      case '\\':
+        return Edge(ParseEscape());
+      default:
+        return Edge(ByteSet().set(static_cast<unsigned char>(symbol)));
+    }
+  }
+
+  // Called with pos_ just past the backslash.
+  ByteSet ParseEscape() {
+    if (pos_ == pattern_.size()) {
+      Fail("dangling '\\'");
+    }
+    char symbol = pattern_[pos_++];
+    if (symbol == 'd') {
+      return RangeBytes('0', '9');
+    }
+    if (symbol == 'w') {
+      return RangeBytes('0', '9') | RangeBytes('a', 'z') |
+             RangeBytes('A', 'Z') | ByteSet().set('_');
+    }
+    return ByteSet().set(static_cast<unsigned char>(symbol));
+  }
+
+  unsigned char ClassByte() {
+    if (pos_ == pattern_.size()) {
+      Fail("missing ']'");
+    }
+    char symbol = pattern_[pos_++];
+    if (symbol == '\\') {
+      if (pos_ == pattern_.size()) {
+        Fail("dangling '\\'");
+      }
+      symbol = pattern_[pos_++];
+    }
+    return static_cast<unsigned char>(symbol);
+  }
+
+  // Called with pos_ just past the '['; a ']' right after it is literal.
+  ByteSet ParseClass() {
+    bool negate = Peek('^');
+    if (negate) {
+      ++pos_;
+    }
+    ByteSet set;
+    for (bool first = true;; first = false) {
+      if (pos_ == pattern_.size()) {
+        Fail("missing ']'");
+      }
+      if (Peek(']') && !first) {
+        ++pos_;
+        break;
+      }
+      if (Peek('\\') && pos_ + 1 < pattern_.size() &&
+          (pattern_[pos_ + 1] == 'd' || pattern_[pos_ + 1] == 'w')) {
+        ++pos_;
+        set |= ParseEscape();
+        continue;
+      }
+      unsigned char low = ClassByte();
+      if (Peek('-') && pos_ + 1 < pattern_.size() &&
+          pattern_[pos_ + 1] != ']') {
+        ++pos_;
+        unsigned char high = ClassByte();
+        if (high < low) {
+          Fail("reversed range");
+        }
+        set |= RangeBytes(low, high);
+      } else {
+        set.set(low);
+      }
+    }
+    return negate ? ~set : set;
+  }
+
+  Fragment Edge(ByteSet bytes) {
+    int start = nfa_.Add();
+    int end = nfa_.Add();
+    nfa_.states[start].bytes = bytes & ~SpaceBytes();
+    nfa_.states[start].next = end;
+    return {start, end};
+  }
+
+  std::string_view pattern_;
+  Nfa& nfa_;
+  size_t pos_ = 0;
+};
+
+std::vector<int> Closure(const Nfa& nfa, std::vector<int> states) {
+  std::vector<bool> seen(nfa.states.size());
+  for (int state : states) {
+    seen[state] = true;
+  }
+  for (size_t i = 0; i < states.size(); ++i) {
+    for (int next : nfa.states[states[i]].epsilon) {
+      if (!seen[next]) {
+        seen[next] = true;
+        states.push_back(next);
+      }
+    }
+  }
+  std::sort(states.begin(), states.end());
+  states.erase(std::unique(states.begin(), states.end()), states.end());
+  return states;
+}
+
+}  // namespace
+
+TokenGrammar::TokenType TokenGrammar::AddToken(std::string name,
+                                               std::string_view pattern) {
+  // Parse eagerly so a bad pattern is reported where it is registered.
+  Nfa scratch;
+  PatternParser(pattern, scratch).Parse();
+  names_.push_back(std::move(name));
+  patterns_.emplace_back(pattern);
+  compiled_ = false;
+  return names_.size() - 1;
+}
+
+void TokenGrammar::Compile() {
+  Nfa nfa;
+  int start = nfa.Add();
+  for (size_t type = 0; type < patterns_.size(); ++type) {
+    Fragment fragment = PatternParser(patterns_[type], nfa).Parse();
+    nfa.states[fragment.end].accept = type;
+    nfa.Link(start, fragment.start);
+  }
+
+  // Bytes get the same class when every edge treats them alike; the
+  // whitespace signature is seeded first so that it becomes class 0.
+  ByteSet spaces = SpaceBytes();
+  std::vector<const ByteSet*> sets = {&spaces};
+  for (const Nfa::State& state : nfa.states) {
+    if (state.next != -1) {
+      sets.push_back(&state.bytes);
+    }
+  }
+  std::map<std::vector<bool>, uint16_t> signatures;
+  std::vector<unsigned char> representative;
+  classes_.assign(256, kSpaceClass);
+  for (size_t pass = 0; pass < 2; ++pass) {
+    for (size_t byte = 0; byte < 256; ++byte) {
+      if (spaces[byte] != (pass == 0)) {
+        continue;
+      }
+      std::vector<bool> signature;
+      for (const ByteSet* set : sets) {
+        signature.push_back((*set)[byte]);
+      }
+      auto [it, inserted] = signatures.emplace(signature, signatures.size());
+      if (inserted) {
+        representative.push_back(static_cast<unsigned char>(byte));
+      }
+      classes_[byte] = it->second;
+    }
+  }
+  class_count_ = representative.size();
+  row_shift_ = std::bit_width(class_count_ - 1);
+
+  // Subset construction; DFA state 0 is the closure of the NFA start.
+  std::map<std::vector<int>, uint32_t> ids;
+  std::vector<std::vector<int>> subsets = {Closure(nfa, {start})};
+  ids.emplace(subsets[0], kStartState);
+  transitions_.clear();
+  accept_.clear();
+  for (size_t id = 0; id < subsets.size(); ++id) {
+    TokenType accept = kUnmatched;
+    for (int state : subsets[id]) {
+      accept = std::min(accept, nfa.states[state].accept);
+    }
+    accept_.push_back(accept);
+    transitions_.push_back(static_cast<uint32_t>(id << row_shift_));
+    for (size_t byte_class = 1; byte_class < class_count_; ++byte_class) {
+      std::vector<int> moved;
+      for (int state : subsets[id]) {
+        const Nfa::State& from = nfa.states[state];
+        if (from.next != -1 && from.bytes[representative[byte_class]]) {
+          moved.push_back(from.next);
+        }
+      }
+      std::vector<int> target = Closure(nfa, std::move(moved));
+      auto [it, inserted] = ids.emplace(target, subsets.size());
+      if (inserted) {
+        if (subsets.size() == kMaxStates) {
+          throw std::length_error("token grammar needs too many DFA states");
+        }
+        subsets.push_back(std::move(target));
+      }
+      transitions_.push_back(it->second << row_shift_);
+    }
+    transitions_.resize((id + 1) << row_shift_);
+  }
+  auto dead = ids.find({});
+  DecideDecimals(dead == ids.end() ? UINT32_MAX : dead->second << row_shift_);
+  compiled_ = true;
+}
+
+void TokenGrammar::DecideDecimals(uint32_t dead_row) {
+  decimals_only_ = false;
+  if (dead_row == UINT32_MAX) {
+    return;
+  }
+  // Only decimals can match when every non-digit byte leads every state
+  // that tokens reach into the dead one.
+  std::set<uint32_t> reached = {kStartState};
+  std::vector<uint32_t> walk = {kStartState};
+  while (!walk.empty()) {
+    uint32_t from = walk.back();
+    walk.pop_back();
+    for (size_t byte = 0; byte < 256; ++byte) {
+      if (classes_[byte] == kSpaceClass) {
+        continue;
+      }
+      uint32_t to = transitions_[from + classes_[byte]];
+      if (byte - '0' > 9 && to != dead_row) {
+        return;
+      }
+      if (reached.insert(to).second) {
+        walk.push_back(to);
+      }
+    }
+  }
+  std::set<uint16_t> digit_classes;
+  for (char digit = '0'; digit <= '9'; ++digit) {
+    digit_classes.insert(classes_[static_cast<unsigned char>(digit)]);
+  }
+  for (char first = '0'; first <= '9'; ++first) {
+    uint16_t first_class = classes_[static_cast<unsigned char>(first)];
+    uint32_t row = transitions_[kStartState + first_class];
+    decimal_types_[first - '0'][0] = accept_[row >> row_shift_];
+    // Every state that one or more further digits reach must accept the
+    // same type.
+    std::set<uint32_t> seen;
+    std::vector<uint32_t> pending = {row};
+    bool first_longer = true;
+    while (!pending.empty()) {
+      uint32_t from = pending.back();
+      pending.pop_back();
+      for (uint16_t byte_class : digit_classes) {
+        uint32_t to = transitions_[from + byte_class];
+        TokenType type = accept_[to >> row_shift_];
+        if (first_longer) {
+          decimal_types_[first - '0'][1] = type;
+          first_longer = false;
+        } else if (decimal_types_[first - '0'][1] != type) {
+          return;
+        }
+        if (seen.insert(to).second) {
+          pending.push_back(to);
+        }
+      }
+    }
+  }
+  decimals_only_ = true;
+}
+
+bool TokenGrammar::compiled() const { return compiled_; }
+
+size_t TokenGrammar::size() const { return names_.size(); }
+
+const std::string& TokenGrammar::name(TokenType type) const {
+  return names_.at(type);
+}
+
+size_t TokenGrammar::stateCount() const { return accept_.size(); }
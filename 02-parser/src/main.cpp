@@ -2,7 +2,7 @@
 
 #include "parser.hpp"
 
-int main() {
+int main(int argc, char* argv[]) {
   TokenParser parser;
   std::vector<uint64_t> nums;
   std::vector<std::string> strings;
@@ -21,12 +21,22 @@ int main() {
     strings.push_back(str);
   });
 
-  std::string line;
-  while (std::getline(std::cin, line)) {
-    if (line == "exit") {
-      break;
+  if (argc > 1) {
+    // Whole-input mode: "-" streams stdin, anything else is a file path.
+    std::string path = argv[1];
+    if (path == "-") {
+      parser.ParseStream(std::cin);
+    } else {
+      parser.ParseFile(path);
+    }
+  } else {
+    std::string line;
+    while (std::getline(std::cin, line)) {
+      if (line == "exit") {
+        break;
+      }
+      parser.Parse(line);
     }
-    parser.Parse(line);
   }
 
   std::cout << "NUMS: ";
@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "parser.hpp"
+#include "tokenizer.hpp"
+
+namespace {
+
+constexpr size_t kMinChunkSize = size_t(1) << 16;
+constexpr size_t kChunksPerThread = 4;
+// In ordered mode workers may run at most this many chunks per thread
+// ahead of delivery, which bounds the reorder buffer.
+constexpr size_t kWindowPerThread = 4;
+
+struct ParsedToken {
+  std::string_view text;
+  uint64_t num;
+  bool digit;
+  TokenGrammar::TokenType type;
+};
+
+// Cuts text into about count pieces, moving every cut forward to the next
+// whitespace so that no token is split.
+std::vector<std::string_view> SplitChunks(std::string_view text,
+                                          size_t count) {
+  size_t target = std::max(kMinChunkSize, text.size() / count + 1);
+  std::vector<std::string_view> chunks;
+  size_t begin = 0;
+  while (begin < text.size()) {
+    size_t end = std::min(text.size(), begin + target);
+    while (end < text.size() && !tokenizer::IsSpace(text[end])) {
+      ++end;
+    }
+    chunks.push_back(text.substr(begin, end - begin));
+    begin = end;
+  }
+  return chunks;
+}
+
+}  // namespace
+
+void TokenParser::ParseParallel(std::string_view string, size_t threads,
+                                Delivery delivery) const {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  std::vector<std::string_view> chunks =
+      SplitChunks(string, threads * kChunksPerThread);
+  if (threads == 1 || chunks.size() <= 1) {
+    Parse(string);
+    return;
+  }
+  threads = std::min(threads, chunks.size());
+
+  if (startcallback_) {
+    startcallback_();
+  }
+  if (delivery == Delivery::kOrdered) {
+    ParseOrdered(chunks, threads);
+  } else {
+    ParseUnordered(chunks, threads);
+  }
+  if (endcallback_) {
+    endcallback_();
+  }
+}
+
+void TokenParser::ParseOrdered(const std::vector<std::string_view>& chunks,
+                               size_t threads) const {
+  struct Slot {
+    std::vector<ParsedToken> tokens;
+    bool ready = false;
+  };
+
+  std::vector<Slot> slots(chunks.size());
+  std::mutex mutex;
+  std::condition_variable changed;
+  size_t claimed = 0;
+  size_t delivered = 0;
+  bool stop = false;
+  const size_t window = threads * kWindowPerThread;
+
+  auto worker = [&] {
+    while (true) {
+      size_t index;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] {
+          return stop || claimed == chunks.size() ||
+                 claimed < delivered + window;
+        });
+        if (stop || claimed == chunks.size()) {
+          return;
+        }
+        index = claimed++;
+      }
+      std::vector<ParsedToken> tokens;
+      tokenizer::ForEachToken(
+          chunks[index], [&](std::string_view token, bool all_digits) {
+            uint64_t num = 0;
+            TokenGrammar::TokenType type;
+            bool digit = ClassifyToken(token, all_digits, type, num);
+            tokens.push_back({token, num, digit, type});
+          });
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        slots[index].tokens = std::move(tokens);
+        slots[index].ready = true;
+      }
+      changed.notify_all();
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < threads; ++i) {
+    workers.emplace_back(worker);
+  }
+  auto join = [&workers] {
+    for (std::thread& thread : workers) {
+      thread.join();
+    }
+  };
+
+  TokenBatch batch;
+  const char* input = chunks.front().data();
+  try {
+    for (size_t i = 0; i < chunks.size(); ++i) {
+      std::vector<ParsedToken> tokens;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return slots[i].ready; });
+        tokens = std::move(slots[i].tokens);
+        delivered = i + 1;
+      }
+      changed.notify_all();
+      for (const ParsedToken& token : tokens) {
+        size_t position = token.text.data() - input;
+        if (!token.digit && !StringType(token.type)) {
+          HandleToken(token.text, token.type);
+        } else if (Batching()) {
+          if (token.digit) {
+            HandlerToken(token.num, position, batch);
+          } else {
+            HandlerToken(token.text, position, batch);
+          }
+        } else if (token.digit) {
+          HandlerToken(token.num);
+        } else {
+          HandlerToken(token.text);
+        }
+      }
+    }
+    FlushBatch(batch);
+  } catch (...) {
+    // A callback threw: let the workers finish their chunk and leave.
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    changed.notify_all();
+    join();
+    throw;
+  }
+  join();
+}
+
+void TokenParser::ParseUnordered(const std::vector<std::string_view>& chunks,
+                                 size_t threads) const {
+  std::atomic<size_t> next = 0;
+  std::atomic<bool> failed = false;
+  std::exception_ptr error;
+  std::mutex error_mutex;
+
+  auto worker = [&] {
+    try {
+      for (size_t index = next++; index < chunks.size() && !failed;
+           index = next++) {
+        ScanTokens(chunks[index], chunks[index].data() - chunks.front().data());
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(error_mutex);
+      if (!error) {
+        error = std::current_exception();
+      }
+      failed = true;
+    }
+  };
+
+  // The calling thread works too, so only threads - 1 are spawned.
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < threads; ++i) {
+    workers.emplace_back(worker);
+  }
+  worker();
+  for (std::thread& thread : workers) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
@@ -1,8 +1,115 @@
 #include "parser.hpp"
 
-#include <algorithm>
-#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <istream>
+#include <streambuf>
+#include <stdexcept>
 #include <string>
+#include <vector>
+
+#include "tokenizer.hpp"
+
+namespace {
+
+// Read-only private mapping of a whole regular file, unmapped on scope
+// exit. Anything else (pipes, terminals, procfs files whose st_size is 0)
+// is only opened.
+class FileMapping {
+ public:
+  explicit FileMapping(const std::string& path)
+      : descriptor_(open(path.c_str(), O_RDONLY)) {
+    struct stat info;
+    if (descriptor_ < 0 || fstat(descriptor_, &info) != 0 ||
+        !S_ISREG(info.st_mode)) {
+      return;
+    }
+    regular_ = true;
+    size_ = info.st_size;
+    if (size_ == 0) {
+      return;
+    }
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, descriptor_, 0);
+    if (data != MAP_FAILED) {
+      data_ = static_cast<const char*>(data);
+      madvise(data, size_, MADV_SEQUENTIAL);
+    }
+  }
+
+  ~FileMapping() {
+    if (data_ != nullptr) {
+      munmap(const_cast<char*>(data_), size_);
+    }
+    if (descriptor_ >= 0) {
+      close(descriptor_);
+    }
+  }
+
+  FileMapping(const FileMapping&) = delete;
+  FileMapping& operator=(const FileMapping&) = delete;
+
+  bool opened() const { return descriptor_ >= 0; }
+  bool mapped() const { return data_ != nullptr || (regular_ && size_ == 0); }
+  int descriptor() const { return descriptor_; }
+  std::string_view contents() const { return {data_, size_}; }
+
+ private:
+  int descriptor_;
+  bool regular_ = false;
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Input stream buffer over a descriptor it does not own. Reading the
+// descriptor FileMapping already opened, rather than opening the path
+// again, keeps whatever a pipe's writer has sent and does not wait for a
+// second writer.
+class DescriptorBuffer : public std::streambuf {
+ public:
+  explicit DescriptorBuffer(int descriptor)
+      : descriptor_(descriptor), buffer_(TokenParser::kStreamBlockSize) {}
+
+ protected:
+  int_type underflow() override {
+    ssize_t count;
+    do {
+      count = read(descriptor_, buffer_.data(), buffer_.size());
+    } while (count < 0 && errno == EINTR);
+    if (count <= 0) {
+      return traits_type::eof();
+    }
+    setg(buffer_.data(), buffer_.data(), buffer_.data() + count);
+    return traits_type::to_int_type(buffer_[0]);
+  }
+
+ private:
+  int descriptor_;
+  std::vector<char> buffer_;
+};
+
+// Canonical decimals, the only type of the built-in grammar. Tokens with
+// leading zeros stay strings.
+const TokenGrammar& DefaultGrammar() {
+  static const TokenGrammar grammar = [] {
+    TokenGrammar built_in;
+    built_in.AddToken("digit", "0|[1-9]\\d*");
+    built_in.Compile();
+    return built_in;
+  }();
+  return grammar;
+}
+
+constexpr TokenGrammar::TokenType kDefaultDigitType = 0;
+
+}  // namespace
+
+TokenParser::TokenParser()
+    : grammar_(DefaultGrammar()), digittype_(kDefaultDigitType) {}
 
 void TokenParser::SetStartCallback(CallBack function) {
   startcallback_ = function;
@@ -18,28 +125,202 @@ void TokenParser::SetStringTokenCallback(StringCallBack function) {
   stringcallback_ = function;
 }
 
-void TokenParser::Parse(const std::string& string) const {
+void TokenParser::SetStringTokenViewCallback(StringViewCallBack function) {
+  stringviewcallback_ = function;
+}
+
+void TokenParser::SetDigitBatchCallback(DigitBatchCallBack function) {
+  digitbatchcallback_ = function;
+}
+
+void TokenParser::SetStringBatchCallback(StringBatchCallBack function) {
+  stringbatchcallback_ = function;
+}
+
+void TokenParser::SetGrammar(TokenGrammar grammar) {
+  if (!grammar.compiled()) {
+    grammar.Compile();
+  }
+  grammar_ = std::move(grammar);
+  digittype_ = TokenGrammar::kUnmatched;
+}
+
+void TokenParser::ClearGrammar() {
+  grammar_ = DefaultGrammar();
+  digittype_ = kDefaultDigitType;
+}
+
+void TokenParser::SetTokenCallback(TokenGrammar::TokenType type,
+                                   TokenCallBack function) {
+  if (tokencallbacks_.size() <= type) {
+    tokencallbacks_.resize(type + 1);
+  }
+  tokencallbacks_[type] = function;
+}
+
+void TokenParser::SetDigitTokenType(TokenGrammar::TokenType type) {
+  digittype_ = type;
+}
+
+void TokenParser::Parse(std::string_view string) const {
   if (startcallback_) {
     startcallback_();
   }
-  std::stringstream ss(string);
-  std::string token;
-  while (ss >> token) {
-    if ((token[0] != '0' || token.size() == 1) &&
-        std::all_of(token.begin(), token.end(), [](unsigned char symbol) {
-          return std::isdigit(symbol) != 0;
-        })) {
-      try {
-        uint64_t num = std::stoull(token);
+  ScanTokens(string);
+  if (endcallback_) {
+    endcallback_();
+  }
+}
+
+void TokenParser::ParseStream(std::istream& stream) const {
+  if (startcallback_) {
+    startcallback_();
+  }
+  std::vector<char> buffer(kStreamBlockSize);
+  size_t carried = 0;
+  size_t consumed = 0;
+  while (stream) {
+    if (carried == buffer.size()) {
+      // One token fills the whole buffer; make room for the rest of it.
+      buffer.resize(buffer.size() * 2);
+    }
+    stream.read(buffer.data() + carried, buffer.size() - carried);
+    size_t filled = carried + stream.gcount();
+    // The bytes after the last whitespace may continue in the next read.
+    size_t cut = filled;
+    while (cut > 0 && !tokenizer::IsSpace(buffer[cut - 1])) {
+      --cut;
+    }
+    ScanTokens(std::string_view(buffer.data(), cut), consumed);
+    consumed += cut;
+    carried = filled - cut;
+    std::memmove(buffer.data(), buffer.data() + cut, carried);
+  }
+  ScanTokens(std::string_view(buffer.data(), carried), consumed);
+  if (endcallback_) {
+    endcallback_();
+  }
+}
+
+void TokenParser::ParseFile(const std::string& path) const {
+  FileMapping mapping(path);
+  if (!mapping.opened()) {
+    throw std::runtime_error("cannot open " + path);
+  }
+  if (!mapping.mapped()) {
+    // Pipes and special files cannot be mapped; read them instead.
+    DescriptorBuffer buffer(mapping.descriptor());
+    std::istream stream(&buffer);
+    ParseStream(stream);
+    return;
+  }
+  Parse(mapping.contents());
+}
+
+void TokenParser::ScanTokens(std::string_view string, size_t offset) const {
+  if (!Batching()) {
+    tokenizer::ForEachToken(string, [this](std::string_view token,
+                                           bool all_digits) {
+      TokenGrammar::TokenType type;
+      uint64_t num;
+      if (ClassifyToken(token, all_digits, type, num)) {
         HandlerToken(num);
-      } catch (const std::exception&) {
+      } else if (StringType(type)) {
         HandlerToken(token);
+      } else {
+        HandleToken(token, type);
+      }
+    });
+    return;
+  }
+  TokenBatch batch;
+  if (!PerToken()) {
+    // Only batches are wanted: tokens go straight into the arrays, with no
+    // per-token dispatch in between.
+    tokenizer::ForEachToken(string, [&](std::string_view token,
+                                        bool all_digits) {
+      size_t position = offset + (token.data() - string.data());
+      TokenGrammar::TokenType type;
+      uint64_t num;
+      if (ClassifyToken(token, all_digits, type, num)) {
+        BatchToken(num, position, batch);
+      } else if (StringType(type)) {
+        BatchToken(token, position, batch);
+      } else {
+        HandleToken(token, type);
       }
+    });
+    FlushBatch(batch);
+    return;
+  }
+  tokenizer::ForEachToken(string, [&](std::string_view token,
+                                      bool all_digits) {
+    size_t position = offset + (token.data() - string.data());
+    TokenGrammar::TokenType type;
+    uint64_t num;
+    if (ClassifyToken(token, all_digits, type, num)) {
+      HandlerToken(num, position, batch);
+    } else if (StringType(type)) {
+      HandlerToken(token, position, batch);
     } else {
-      HandlerToken(token);
+      HandleToken(token, type);
     }
+  });
+  FlushBatch(batch);
+}
+
+void TokenParser::HandleToken(std::string_view token,
+                              TokenGrammar::TokenType type) const {
+  if (type < tokencallbacks_.size() && tokencallbacks_[type]) {
+    tokencallbacks_[type](token);
   }
-  if (endcallback_) {
-    endcallback_();
+}
+
+void TokenParser::HandlerToken(uint64_t num, size_t position,
+                               TokenBatch& batch) const {
+  HandlerToken(num);
+  BatchToken(num, position, batch);
+}
+
+void TokenParser::HandlerToken(std::string_view str, size_t position,
+                               TokenBatch& batch) const {
+  HandlerToken(str);
+  BatchToken(str, position, batch);
+}
+
+void TokenParser::BatchToken(uint64_t num, size_t position,
+                             TokenBatch& batch) const {
+  if (digitbatchcallback_) {
+    batch.nums[batch.num_count] = num;
+    batch.num_positions[batch.num_count] = position;
+    if (++batch.num_count == kBatchSize) {
+      FlushBatch(batch);
+    }
+  }
+}
+
+void TokenParser::BatchToken(std::string_view str, size_t position,
+                             TokenBatch& batch) const {
+  if (stringbatchcallback_) {
+    batch.strs[batch.str_count] = str;
+    batch.str_positions[batch.str_count] = position;
+    if (++batch.str_count == kBatchSize) {
+      FlushBatch(batch);
+    }
+  }
+}
+
+void TokenParser::FlushBatch(TokenBatch& batch) const {
+  if (batch.num_count != 0) {
+    digitbatchcallback_(
+        std::span<const uint64_t>(batch.nums.data(), batch.num_count),
+        std::span<const size_t>(batch.num_positions.data(), batch.num_count));
+    batch.num_count = 0;
+  }
+  if (batch.str_count != 0) {
+    stringbatchcallback_(
+        std::span<const std::string_view>(batch.strs.data(), batch.str_count),
+        std::span<const size_t>(batch.str_positions.data(), batch.str_count));
+    batch.str_count = 0;
   }
 }
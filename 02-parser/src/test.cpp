@@ -1,8 +1,22 @@
 #include <gtest/gtest.h>
+#include <unistd.h>
 
+#include <cctype>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include "basic_parser.hpp"
+#include "grammar.hpp"
 #include "parser.hpp"
+#include "tokenizer.hpp"
 
 class ParserTest : public ::testing::Test {
  protected:
@@ -123,6 +137,497 @@ TEST_F(ParserTest, test_many_lines) {
   ASSERT_EQ(nums[2], 41);
 }
 
+TEST_F(ParserTest, test_string_view_callback) {
+  std::vector<std::string> views;
+  parser.SetStringTokenViewCallback(
+      [&views](std::string_view str) { views.emplace_back(str); });
+  parser.Parse(" \tabc 42\n\r\vdef\f007  ");
+  ASSERT_EQ(status, 0);
+
+  ASSERT_EQ(views, std::vector<std::string>({"abc", "def", "007"}));
+  ASSERT_EQ(strings, views);
+  ASSERT_EQ(nums, std::vector<uint64_t>({42}));
+}
+
+TEST_F(ParserTest, test_non_canonical_numbers) {
+  parser.Parse("+1 1+ 1.5 00 0 007");
+  ASSERT_EQ(strings,
+            std::vector<std::string>({"+1", "1+", "1.5", "00", "007"}));
+  ASSERT_EQ(nums, std::vector<uint64_t>({0}));
+}
+
+TEST_F(ParserTest, test_empty_input) {
+  parser.Parse("");
+  parser.Parse(" \t\n ");
+  ASSERT_EQ(status, 0);
+  ASSERT_TRUE(nums.empty());
+  ASSERT_TRUE(strings.empty());
+}
+
+TEST_F(ParserTest, test_stream_single_start_end) {
+  int starts = 0;
+  parser.SetStartCallback([&starts, this]() {
+    ++starts;
+    ++this->status;
+  });
+  std::istringstream stream("abc 12\nxyz\n\n 7 0x1\n");
+  parser.ParseStream(stream);
+  ASSERT_EQ(status, 0);
+  ASSERT_EQ(starts, 1);
+  ASSERT_EQ(strings, std::vector<std::string>({"abc", "xyz", "0x1"}));
+  ASSERT_EQ(nums, std::vector<uint64_t>({12, 7}));
+}
+
+TEST_F(ParserTest, test_stream_block_boundaries) {
+  // Put a number right across the first read boundary and a string token
+  // longer than a whole block after it.
+  std::string input(TokenParser::kStreamBlockSize - 3, ' ');
+  input += "123456 ";
+  input += std::string(3 * TokenParser::kStreamBlockSize, 'x');
+  input += " 42";
+  std::istringstream stream(input);
+  parser.ParseStream(stream);
+  ASSERT_EQ(nums, std::vector<uint64_t>({123456, 42}));
+  ASSERT_EQ(strings.size(), 1);
+  ASSERT_EQ(strings[0].size(), 3 * TokenParser::kStreamBlockSize);
+}
+
+TEST_F(ParserTest, test_file) {
+  std::string path = ::testing::TempDir() + "parser_test_file.txt";
+  {
+    std::ofstream file(path);
+    file << "first 1\nsecond 2\n" << std::string(100000, 'y') << " 3";
+  }
+  parser.ParseFile(path);
+  std::remove(path.c_str());
+  ASSERT_EQ(status, 0);
+  ASSERT_EQ(nums, std::vector<uint64_t>({1, 2, 3}));
+  ASSERT_EQ(strings.size(), 3);
+  ASSERT_EQ(strings[2], std::string(100000, 'y'));
+
+  ASSERT_THROW(parser.ParseFile(path), std::runtime_error);
+}
+
+TEST_F(ParserTest, test_file_through_pipe) {
+  // A pipe reports st_size 0 but is not empty; it must be read, not
+  // mapped.
+  int ends[2];
+  ASSERT_EQ(pipe(ends), 0);
+  std::string input = "piped 7 through 8\n";
+  ASSERT_EQ(write(ends[1], input.data(), input.size()),
+            ssize_t(input.size()));
+  close(ends[1]);
+  parser.ParseFile("/dev/fd/" + std::to_string(ends[0]));
+  close(ends[0]);
+  ASSERT_EQ(status, 0);
+  ASSERT_EQ(nums, std::vector<uint64_t>({7, 8}));
+  ASSERT_EQ(strings, std::vector<std::string>({"piped", "through"}));
+}
+
+TEST_F(ParserTest, test_batches) {
+  std::string input;
+  std::vector<size_t> expected_positions;
+  for (size_t i = 0; i < 3 * TokenParser::kBatchSize + 5; ++i) {
+    expected_positions.push_back(input.size());
+    input += std::to_string(i) + " x" + (i % 3 == 0 ? "\n" : " ");
+  }
+
+  std::vector<uint64_t> batched_nums;
+  std::vector<size_t> positions;
+  size_t batches = 0;
+  size_t batched_strings = 0;
+  parser.SetDigitBatchCallback([&](std::span<const uint64_t> values,
+                                   std::span<const size_t> offsets) {
+    ASSERT_LE(values.size(), TokenParser::kBatchSize);
+    ASSERT_EQ(values.size(), offsets.size());
+    batched_nums.insert(batched_nums.end(), values.begin(), values.end());
+    positions.insert(positions.end(), offsets.begin(), offsets.end());
+    ++batches;
+  });
+  parser.SetStringBatchCallback([&](std::span<const std::string_view> strs,
+                                    std::span<const size_t> offsets) {
+    for (size_t i = 0; i < strs.size(); ++i) {
+      ASSERT_EQ(strs[i], "x");
+      ASSERT_EQ(input[offsets[i]], 'x');
+    }
+    batched_strings += strs.size();
+  });
+
+  parser.Parse(input);
+  ASSERT_EQ(status, 0);
+  ASSERT_EQ(batches, 4);
+  ASSERT_EQ(batched_nums, nums);
+  ASSERT_EQ(positions, expected_positions);
+  ASSERT_EQ(batched_strings, strings.size());
+
+  batched_nums.clear();
+  positions.clear();
+  parser.SetStringBatchCallback(nullptr);
+  std::istringstream stream(std::string(TokenParser::kStreamBlockSize, ' ') +
+                            input);
+  parser.ParseStream(stream);
+  ASSERT_EQ(batched_nums.size(), expected_positions.size());
+  ASSERT_EQ(positions[0], TokenParser::kStreamBlockSize);
+  ASSERT_EQ(positions.back(),
+            TokenParser::kStreamBlockSize + expected_positions.back());
+
+  // Without per-token callbacks, tokens go straight into the batches.
+  batched_nums.clear();
+  positions.clear();
+  batched_strings = 0;
+  parser.SetDigitTokenCallback(nullptr);
+  parser.SetStringTokenCallback(nullptr);
+  parser.SetStringBatchCallback([&](std::span<const std::string_view> strs,
+                                    std::span<const size_t>) {
+    batched_strings += strs.size();
+  });
+  parser.Parse(input);
+  ASSERT_EQ(positions, expected_positions);
+  ASSERT_EQ(batched_nums.back(), expected_positions.size() - 1);
+  ASSERT_EQ(batched_strings, expected_positions.size());
+}
+
+TEST_F(ParserTest, test_batches_parallel) {
+  std::string input;
+  for (size_t i = 0; i < 100000; ++i) {
+    input += std::to_string(i) + ' ';
+  }
+  for (auto delivery : {TokenParser::Delivery::kOrdered,
+                        TokenParser::Delivery::kUnordered}) {
+    std::mutex mutex;
+    uint64_t sum = 0;
+    bool positions_match = true;
+    parser.SetDigitTokenCallback(nullptr);
+    parser.SetDigitBatchCallback([&](std::span<const uint64_t> values,
+                                     std::span<const size_t> offsets) {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (size_t i = 0; i < values.size(); ++i) {
+        std::string text = std::to_string(values[i]);
+        sum += values[i];
+        positions_match &= input.compare(offsets[i], text.size(), text) == 0;
+      }
+    });
+    parser.ParseParallel(input, 4, delivery);
+    ASSERT_EQ(sum, 99999ull * 100000 / 2);
+    ASSERT_TRUE(positions_match);
+  }
+}
+
+namespace {
+
+std::vector<std::string> Classify(const TokenGrammar& grammar,
+                                  std::string_view text) {
+  std::vector<std::string> types;
+  grammar.ForEachToken(text, [&](std::string_view token,
+                                 TokenGrammar::TokenType type) {
+    std::string name =
+        type == TokenGrammar::kUnmatched ? "?" : grammar.name(type);
+    types.push_back(name + ":" + std::string(token));
+  });
+  return types;
+}
+
+}  // namespace
+
+TEST(GrammarTest, test_token_types) {
+  TokenGrammar grammar;
+  grammar.AddToken("hex", "0[xX][0-9a-fA-F]+");
+  grammar.AddToken("int", "[+-]?(0|[1-9]\\d*)");
+  grammar.AddToken("float", "[+-]?\\d+\\.\\d*([eE][+-]?\\d+)?");
+  grammar.AddToken("quoted", "\"([^\"\\\\]|\\\\.)*\"");
+  grammar.AddToken("ident", "[a-zA-Z_]\\w*");
+  grammar.Compile();
+  ASSERT_EQ(grammar.size(), 5);
+
+  ASSERT_EQ(Classify(grammar, " 0x1F -42 +0 3.25e-4 \"a\\\"b\" _id9\t"
+                              "0x 007 \"open 1.\n"),
+            std::vector<std::string>(
+                {"hex:0x1F", "int:-42", "int:+0", "float:3.25e-4",
+                 "quoted:\"a\\\"b\"", "ident:_id9", "?:0x", "?:007",
+                 "?:\"open", "float:1."}));
+}
+
+TEST(GrammarTest, test_first_pattern_wins) {
+  TokenGrammar grammar;
+  auto keyword = grammar.AddToken("keyword", "if|else");
+  auto ident = grammar.AddToken("ident", "[a-z]+");
+  grammar.Compile();
+  std::vector<TokenGrammar::TokenType> types;
+  grammar.ForEachToken("if iff else", [&](std::string_view,
+                                          TokenGrammar::TokenType type) {
+    types.push_back(type);
+  });
+  ASSERT_EQ(types, std::vector<TokenGrammar::TokenType>(
+                       {keyword, ident, keyword}));
+}
+
+TEST(GrammarTest, test_bad_patterns) {
+  TokenGrammar grammar;
+  for (const char* pattern : {"(ab", "ab)", "[a-", "*a", "a|+", "[z-a]",
+                              "\\"}) {
+    ASSERT_THROW(grammar.AddToken("bad", pattern), std::invalid_argument)
+        << pattern;
+  }
+  ASSERT_EQ(grammar.size(), 0);
+}
+
+TEST_F(ParserTest, test_grammar_callbacks) {
+  TokenGrammar grammar;
+  auto hex = grammar.AddToken("hex", "0x[0-9a-f]+");
+  auto number = grammar.AddToken("number", "-?\\d+");
+  std::vector<std::string> hexes;
+  std::vector<std::string> numbers;
+  parser.SetGrammar(grammar);
+  parser.SetTokenCallback(hex, [&](std::string_view token) {
+    hexes.emplace_back(token);
+  });
+  parser.SetTokenCallback(number, [&](std::string_view token) {
+    numbers.emplace_back(token);
+  });
+
+  parser.Parse("0xff -12 word 0x 99");
+  ASSERT_EQ(status, 0);
+  ASSERT_EQ(hexes, std::vector<std::string>({"0xff"}));
+  ASSERT_EQ(numbers, std::vector<std::string>({"-12", "99"}));
+  ASSERT_EQ(strings, std::vector<std::string>({"word", "0x"}));
+  ASSERT_TRUE(nums.empty());
+
+  std::string input;
+  for (size_t i = 0; i < 100000; ++i) {
+    input += "-" + std::to_string(i) + " ";
+  }
+  numbers.clear();
+  parser.ParseParallel(input, 4);
+  ASSERT_EQ(numbers.size(), 100000);
+  ASSERT_EQ(numbers[99999], "-99999");
+
+  parser.ClearGrammar();
+  parser.Parse("0xff 12");
+  ASSERT_EQ(nums, std::vector<uint64_t>({12}));
+}
+
+TEST_F(ParserTest, test_grammar_digit_type) {
+  TokenGrammar grammar;
+  auto hex = grammar.AddToken("hex", "0x[0-9a-f]+");
+  auto digit = grammar.AddToken("digit", "\\d+");
+  std::vector<std::string> hexes;
+  parser.SetGrammar(grammar);
+  parser.SetDigitTokenType(digit);
+  parser.SetTokenCallback(hex, [&](std::string_view token) {
+    hexes.emplace_back(token);
+  });
+
+  parser.Parse("0x1f 42 18446744073709551615 18446744073709551616 007 x");
+  ASSERT_EQ(status, 0);
+  ASSERT_EQ(hexes, std::vector<std::string>({"0x1f"}));
+  ASSERT_EQ(nums, std::vector<uint64_t>({42, 18446744073709551615ull, 7}));
+  ASSERT_EQ(strings,
+            std::vector<std::string>({"18446744073709551616", "x"}));
+
+  std::vector<uint64_t> batched;
+  parser.SetDigitBatchCallback([&](std::span<const uint64_t> batch,
+                                   std::span<const size_t>) {
+    batched.insert(batched.end(), batch.begin(), batch.end());
+  });
+  hexes.clear();
+  parser.Parse("0x2a 42 x 7");
+  ASSERT_EQ(hexes, std::vector<std::string>({"0x2a"}));
+  ASSERT_EQ(batched, std::vector<uint64_t>({42, 7}));
+  parser.SetDigitBatchCallback(nullptr);
+
+  std::string input;
+  for (size_t i = 0; i < 100000; ++i) {
+    input += std::to_string(i) + " 0x" + std::to_string(i % 10) + " ";
+  }
+  nums.clear();
+  hexes.clear();
+  parser.ParseParallel(input, 4);
+  ASSERT_EQ(nums.size(), 100000);
+  ASSERT_EQ(nums[99999], 99999);
+  ASSERT_EQ(hexes.size(), 100000);
+
+  std::vector<std::string> digits;
+  parser.SetDigitTokenType(TokenGrammar::kUnmatched);
+  parser.SetTokenCallback(digit, [&](std::string_view token) {
+    digits.emplace_back(token);
+  });
+  parser.Parse("42");
+  ASSERT_EQ(digits, std::vector<std::string>({"42"}));
+
+  nums.clear();
+  strings.clear();
+  parser.ClearGrammar();
+  parser.Parse("42 007 0x1f");
+  ASSERT_EQ(nums, std::vector<uint64_t>({42}));
+  ASSERT_EQ(strings, std::vector<std::string>({"007", "0x1f"}));
+}
+
+TEST(BasicParserTest, test_static_callbacks) {
+  std::vector<uint64_t> nums;
+  std::vector<std::string> strings;
+  int status = 0;
+  BasicTokenParser parser(
+      [&nums](uint64_t num) { nums.push_back(num); },
+      [&strings](std::string_view str) { strings.emplace_back(str); },
+      [&status] { ++status; }, [&status] { --status; });
+
+  parser.Parse("123go 18446744073709551615 0 0123 -1 18446744073709551616");
+  ASSERT_EQ(status, 0);
+  ASSERT_EQ(nums, std::vector<uint64_t>({18446744073709551615ull, 0}));
+  ASSERT_EQ(strings, std::vector<std::string>({"123go", "0123", "-1",
+                                               "18446744073709551616"}));
+}
+
+TEST(BasicParserTest, test_optional_callbacks) {
+  struct Sum {
+    void operator()(uint64_t num) { *total += num; }
+    uint64_t* total;
+  };
+
+  uint64_t total = 0;
+  BasicTokenParser<Sum> parser(Sum{&total});
+  parser.Parse("1 2 three 4");
+  ASSERT_EQ(total, 7);
+
+  BasicTokenParser silent;
+  silent.Parse("nothing to see 42");
+}
+
+namespace {
+
+std::string MakeLargeInput() {
+  std::mt19937 random(7);
+  std::string input;
+  while (input.size() < 3 * TokenParser::kStreamBlockSize * 4) {
+    input += random() % 2 == 0 ? std::to_string(random())
+                               : "w" + std::to_string(random() % 100);
+    input += random() % 5 == 0 ? '\n' : ' ';
+  }
+  return input;
+}
+
+}  // namespace
+
+TEST_F(ParserTest, test_parallel_ordered) {
+  std::string input = MakeLargeInput();
+  parser.Parse(input);
+  std::vector<uint64_t> expected_nums = std::move(nums);
+  std::vector<std::string> expected_strings = std::move(strings);
+  nums.clear();
+  strings.clear();
+
+  for (size_t threads : {1, 2, 3, 8}) {
+    parser.ParseParallel(input, threads);
+    ASSERT_EQ(status, 0);
+    ASSERT_EQ(nums, expected_nums);
+    ASSERT_EQ(strings, expected_strings);
+    nums.clear();
+    strings.clear();
+  }
+}
+
+TEST_F(ParserTest, test_parallel_unordered) {
+  std::string input = MakeLargeInput();
+  parser.Parse(input);
+  std::multiset<uint64_t> expected(nums.begin(), nums.end());
+  size_t expected_strings = strings.size();
+
+  std::mutex mutex;
+  std::multiset<uint64_t> seen;
+  size_t seen_strings = 0;
+  parser.SetDigitTokenCallback([&](uint64_t num) {
+    std::lock_guard<std::mutex> lock(mutex);
+    seen.insert(num);
+  });
+  parser.SetStringTokenViewCallback([&](std::string_view) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++seen_strings;
+  });
+  parser.SetStringTokenCallback(nullptr);
+  parser.ParseParallel(input, 4, TokenParser::Delivery::kUnordered);
+  ASSERT_EQ(status, 0);
+  ASSERT_EQ(seen, expected);
+  ASSERT_EQ(seen_strings, expected_strings);
+}
+
+TEST_F(ParserTest, test_parallel_callback_exception) {
+  std::string input = MakeLargeInput();
+  parser.SetDigitTokenCallback([](uint64_t) {
+    throw std::runtime_error("stop");
+  });
+  ASSERT_THROW(parser.ParseParallel(input, 4), std::runtime_error);
+  ASSERT_THROW(
+      parser.ParseParallel(input, 4, TokenParser::Delivery::kUnordered),
+      std::runtime_error);
+}
+
+namespace {
+
+using Tokens = std::vector<std::pair<std::string, bool>>;
+
+Tokens ReferenceTokens(const std::string& text) {
+  Tokens tokens;
+  size_t i = 0;
+  while (i < text.size()) {
+    if (std::isspace(static_cast<unsigned char>(text[i]))) {
+      ++i;
+      continue;
+    }
+    size_t begin = i;
+    bool all_digits = true;
+    for (; i < text.size() &&
+           !std::isspace(static_cast<unsigned char>(text[i]));
+         ++i) {
+      all_digits &= std::isdigit(static_cast<unsigned char>(text[i])) != 0;
+    }
+    tokens.emplace_back(text.substr(begin, i - begin), all_digits);
+  }
+  return tokens;
+}
+
+Tokens KernelTokens(const std::string& text, tokenizer::Kernel kernel) {
+  Tokens tokens;
+  tokenizer::ForEachToken(text, tokenizer::Classifier(kernel),
+                          [&tokens](std::string_view token, bool all_digits) {
+                            tokens.emplace_back(std::string(token), all_digits);
+                          });
+  return tokens;
+}
+
+}  // namespace
+
+TEST(TokenizerTest, test_kernels_match_reference) {
+  const std::string alphabet = " \t\n\v\f\r0123456789az-\x80\xff\x08\x0e";
+  std::mt19937 random(2024);
+  for (size_t round = 0; round < 2000; ++round) {
+    std::string text(random() % 300, ' ');
+    size_t run = 1 + random() % 40;
+    for (size_t i = 0; i < text.size(); ++i) {
+      // Long runs of one class stress tokens that straddle block edges.
+      text[i] = alphabet[(i / run + random() % 3) % alphabet.size()];
+    }
+    Tokens expected = ReferenceTokens(text);
+    for (auto kernel : {tokenizer::Kernel::kScalar, tokenizer::Kernel::kSse2,
+                        tokenizer::Kernel::kAvx2}) {
+      if (!tokenizer::IsSupported(kernel)) {
+        continue;
+      }
+      ASSERT_EQ(KernelTokens(text, kernel), expected)
+          << "kernel " << static_cast<int>(kernel) << " on \"" << text
+          << '"';
+    }
+  }
+}
+
+TEST(TokenizerTest, test_block_boundaries) {
+  for (size_t length = 64; length <= 140; ++length) {
+    std::string text(length, '7');
+    text[63] = ' ';
+    Tokens expected = ReferenceTokens(text);
+    ASSERT_EQ(KernelTokens(text, tokenizer::BestKernel()), expected);
+  }
+}
+
 int main(int argc, char* argv[]) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
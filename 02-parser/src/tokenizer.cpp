@@ -0,0 +1,127 @@
+#include "tokenizer.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TOKENIZER_X86 1
+#endif
+
+namespace tokenizer {
+
+BlockMasks ClassifyScalar(const char* block) {
+  BlockMasks masks = {0, 0};
+  for (size_t i = 0; i < kBlockSize; ++i) {
+    unsigned char symbol = block[i];
+    uint64_t bit = uint64_t(1) << i;
+    if (symbol == ' ' || static_cast<unsigned char>(symbol - '\t') <= 4) {
+      masks.space |= bit;
+    }
+    if (static_cast<unsigned char>(symbol - '0') <= 9) {
+      masks.digit |= bit;
+    }
+  }
+  return masks;
+}
+
+#ifdef TOKENIZER_X86
+
+// Both kernels test "x - low <= span" as an unsigned byte comparison,
+// written as min(x - low, span) == x - low because SSE2 and AVX2 only
+// offer signed byte compares.
+
+BlockMasks ClassifySse2(const char* block) {
+  const __m128i blank = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i controls = _mm_set1_epi8(4);
+  const __m128i zero = _mm_set1_epi8('0');
+  const __m128i digits = _mm_set1_epi8(9);
+
+  BlockMasks masks = {0, 0};
+  for (size_t i = 0; i < kBlockSize; i += 16) {
+    __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+    __m128i control = _mm_sub_epi8(bytes, tab);
+    __m128i space = _mm_or_si128(
+        _mm_cmpeq_epi8(bytes, blank),
+        _mm_cmpeq_epi8(_mm_min_epu8(control, controls), control));
+    __m128i digit_offset = _mm_sub_epi8(bytes, zero);
+    __m128i digit =
+        _mm_cmpeq_epi8(_mm_min_epu8(digit_offset, digits), digit_offset);
+    masks.space |= uint64_t(uint16_t(_mm_movemask_epi8(space))) << i;
+    masks.digit |= uint64_t(uint16_t(_mm_movemask_epi8(digit))) << i;
+  }
+  return masks;
+}
+
+__attribute__((target("avx2"))) BlockMasks ClassifyAvx2(const char* block) {
+  const __m256i blank = _mm256_set1_epi8(' ');
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i controls = _mm256_set1_epi8(4);
+  const __m256i zero = _mm256_set1_epi8('0');
+  const __m256i digits = _mm256_set1_epi8(9);
+
+  BlockMasks masks = {0, 0};
+  for (size_t i = 0; i < kBlockSize; i += 32) {
+    __m256i bytes =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i));
+    __m256i control = _mm256_sub_epi8(bytes, tab);
+    __m256i space = _mm256_or_si256(
+        _mm256_cmpeq_epi8(bytes, blank),
+        _mm256_cmpeq_epi8(_mm256_min_epu8(control, controls), control));
+    __m256i digit_offset = _mm256_sub_epi8(bytes, zero);
+    __m256i digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit_offset, digits),
+                                      digit_offset);
+    masks.space |= uint64_t(uint32_t(_mm256_movemask_epi8(space))) << i;
+    masks.digit |= uint64_t(uint32_t(_mm256_movemask_epi8(digit))) << i;
+  }
+  return masks;
+}
+
+bool IsSupported(Kernel kernel) {
+  switch (kernel) {
+    case Kernel::kScalar:
+    case Kernel::kSse2:
+      return true;
+    case Kernel::kAvx2:
+      return __builtin_cpu_supports("avx2");
+  }
+  return false;
+}
+
+#else
+
+BlockMasks ClassifySse2(const char* block) { return ClassifyScalar(block); }
+
+BlockMasks ClassifyAvx2(const char* block) { return ClassifyScalar(block); }
+
+bool IsSupported(Kernel kernel) { return kernel == Kernel::kScalar; }
+
+#endif  // TOKENIZER_X86
+
+Kernel BestKernel() {
+  if (IsSupported(Kernel::kAvx2)) {
+    return Kernel::kAvx2;
+  }
+  if (IsSupported(Kernel::kSse2)) {
+    return Kernel::kSse2;
+  }
+  return Kernel::kScalar;
+}
+
+ClassifyFunction Classifier(Kernel kernel) {
+  switch (kernel) {
+    case Kernel::kAvx2:
+      return ClassifyAvx2;
+    case Kernel::kSse2:
+      return ClassifySse2;
+    case Kernel::kScalar:
+      break;
+  }
+  return ClassifyScalar;
+}
+
+ClassifyFunction DefaultClassifier() {
+  static const ClassifyFunction classify = Classifier(BestKernel());
+  return classify;
+}
+
+}  // namespace tokenizer
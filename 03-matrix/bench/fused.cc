@@ -0,0 +1,44 @@
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+#include "bench.hh"
+#include "matrix.hh"
+
+namespace {
+
+constexpr size_t kRepeats = 5;
+
+void Report(size_t n, const char* name, double ns) {
+  double elements = double(n) * n;
+  // Four matrices of int32 are read or written once in the fused loop.
+  std::cout << std::setw(6) << n << "  " << std::left << std::setw(26)
+            << name << std::right << std::fixed << std::setprecision(3)
+            << std::setw(8) << ns / elements << " ns/el" << std::setw(8)
+            << std::setprecision(1) << 16 * elements / ns << " GB/s\n";
+}
+
+}  // namespace
+
+int main() {
+  std::cout << "r = a + b * 3 + c\n";
+  for (size_t n : {256, 1024, 4096}) {
+    Matrix a(n, n, 1), b(n, n, 2), c(n, n, 3), r(n, n);
+    // What every operator used to cost: one materialized matrix per step.
+    Report(n, "step by step temporaries", bench::BestOf(kRepeats, [&] {
+             Matrix scaled = b;
+             scaled *= 3;
+             Matrix partial = a + scaled;
+             Matrix result = partial + c;
+             bench::DoNotOptimize(result.data());
+           }));
+    Report(n, "fused into a new matrix", bench::BestOf(kRepeats, [&] {
+             Matrix result = a + b * 3 + c;
+             bench::DoNotOptimize(result.data());
+           }));
+    Report(n, "fused into existing r", bench::BestOf(kRepeats, [&] {
+             r = a + b * 3 + c;
+             bench::DoNotOptimize(r.data());
+           }));
+  }
+}
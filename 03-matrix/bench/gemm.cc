@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+#include "bench.hh"
+#include "matrix.hh"
+
+namespace {
+
+constexpr size_t kRepeats = 3;
+// The naive loop takes seconds beyond this size.
+constexpr size_t kNaiveLimit = 1024;
+
+Matrix Naive(const Matrix& a, const Matrix& b) {
+  Matrix c(a.getRows(), b.getColumns());
+  for (size_t i = 0; i < a.getRows(); ++i) {
+    for (size_t j = 0; j < b.getColumns(); ++j) {
+      int32_t sum = 0;
+      for (size_t p = 0; p < a.getColumns(); ++p) {
+        sum += a(i, p) * b(p, j);
+      }
+      c(i, j) = sum;
+    }
+  }
+  return c;
+}
+
+Matrix Filled(size_t n, int32_t seed) {
+  Matrix m(n, n);
+  for (size_t i = 0; i < m.size(); ++i) {
+    m.data()[i] = int32_t((i * 7 + seed) % 19) - 9;
+  }
+  return m;
+}
+
+template <class T>
+BasicMatrix<T> FilledAs(size_t n, int32_t seed) {
+  BasicMatrix<T> m(n, n);
+  for (size_t i = 0; i < m.size(); ++i) {
+    m.data()[i] = T(int32_t((i * 7 + seed) % 19) - 9);
+  }
+  return m;
+}
+
+// Best time of one call. Small products are repeated until a sample does
+// about kSampleOps multiply-adds, so the clock is not what they measure.
+constexpr size_t kSampleOps = size_t(1) << 24;
+
+template <class Function>
+double Measure(size_t n, Function&& function) {
+  size_t iterations = std::max<size_t>(1, kSampleOps / (n * n * n));
+  return bench::BestOf(kRepeats, [&] {
+           for (size_t i = 0; i < iterations; ++i) {
+             function();
+           }
+         }) /
+         double(iterations);
+}
+
+// Integer multiply-adds count as two operations, as in GFLOP/s.
+void Report(size_t n, const char* name, double ns) {
+  double ops = 2.0 * n * n * n;
+  std::cout << std::setw(6) << n << "  " << std::left << std::setw(18) << name
+            << std::right << std::fixed << std::setprecision(2)
+            << std::setw(8) << ops / ns << " GOP/s\n";
+}
+
+template <class T>
+void ReportType(size_t n, const char* name) {
+  BasicMatrix<T> a = FilledAs<T>(n, 1), b = FilledAs<T>(n, 2);
+  Report(n, name, Measure(n, [&] {
+           auto c = a * b;
+           bench::DoNotOptimize(c.data());
+         }));
+}
+
+}  // namespace
+
+int main() {
+  for (size_t n : {4, 16, 64, 128, 512, 1024, 2048}) {
+    Matrix a = Filled(n, 1), b = Filled(n, 2);
+    if (n <= kNaiveLimit) {
+      Report(n, "naive i-j-p loop", Measure(n, [&] {
+               Matrix c = Naive(a, b);
+               bench::DoNotOptimize(c.data());
+             }));
+    }
+    Report(n, "operator*", Measure(n, [&] {
+             Matrix c = a * b;
+             bench::DoNotOptimize(c.data());
+           }));
+    Report(n, "multiplyChecked", Measure(n, [&] {
+             Matrix c = multiplyChecked(a, b);
+             bench::DoNotOptimize(c.data());
+           }));
+  }
+  std::cout << "operator* by element type\n";
+  for (size_t n : {4, 16, 64, 512, 1024}) {
+    ReportType<int8_t>(n, "int8 -> int32");
+    ReportType<int32_t>(n, "int32");
+    ReportType<int64_t>(n, "int64");
+    ReportType<float>(n, "float");
+    ReportType<double>(n, "double");
+  }
+}
@@ -0,0 +1,78 @@
+#include <unistd.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "bench.hh"
+#include "file.hh"
+#include "matrix.hh"
+
+namespace {
+
+constexpr size_t kRepeats = 3;
+constexpr size_t kSize = 4096;
+
+void Report(const char* name, double ns, double bytes) {
+  std::cout << "  " << std::left << std::setw(22) << name << std::right
+            << std::fixed << std::setprecision(3) << std::setw(10)
+            << ns / 1e6 << " ms" << std::setprecision(1) << std::setw(8)
+            << bytes / ns << " GB/s\n";
+}
+
+}  // namespace
+
+int main() {
+  std::string path = (std::filesystem::temp_directory_path() /
+                      ("bench_io_" + std::to_string(::getpid()) + ".bin"))
+                         .string();
+  Matrix m(kSize, kSize);
+  for (size_t i = 0; i < m.size(); ++i) {
+    m.data()[i] = int32_t(i % 1000);
+  }
+  double bytes = double(m.size()) * sizeof(int32_t);
+  std::cout << kSize << " x " << kSize << " int32, " << bytes / (1 << 20)
+            << " MiB\n";
+  // The only format there was before: text through operator<<.
+  Report("print as text", bench::BestOf(1, [&] {
+           std::ofstream text(path + ".txt");
+           text << m;
+         }),
+         bytes);
+  std::filesystem::remove(path + ".txt");
+  Report("save", bench::BestOf(kRepeats, [&] { saveMatrix(path, m); }),
+         bytes);
+  Report("map", bench::BestOf(kRepeats, [&] {
+           MappedMatrix<int32_t> mapped(path);
+           bench::DoNotOptimize(mapped.view().data());
+         }),
+         bytes);
+  Report("map and read a row", bench::BestOf(kRepeats, [&] {
+           MappedMatrix<int32_t> mapped(path);
+           int64_t sum = 0;
+           for (size_t j = 0; j < kSize; ++j) {
+             sum += mapped.view()(kSize / 2, j);
+           }
+           bench::DoNotOptimize(sum);
+         }),
+         bytes);
+  Report("map and verify", bench::BestOf(kRepeats, [&] {
+           MappedMatrix<int32_t> mapped(path);
+           bench::DoNotOptimize(mapped.verify());
+         }),
+         bytes);
+  Report("load", bench::BestOf(kRepeats, [&] {
+           Matrix loaded = loadMatrix<int32_t>(path);
+           bench::DoNotOptimize(loaded.data());
+         }),
+         bytes);
+  Report("copy in memory", bench::BestOf(kRepeats, [&] {
+           Matrix copy = m;
+           bench::DoNotOptimize(copy.data());
+         }),
+         bytes);
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,120 @@
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+#include "bench.hh"
+#include "matrix.hh"
+
+namespace {
+
+constexpr size_t kRepeats = 5;
+
+// The previous layout: one allocation per row behind a checked proxy.
+class LegacyMatrix {
+public:
+  struct Row {
+    int32_t& operator[](size_t j) {
+      if (j >= count_column) {
+        throw std::out_of_range("out of columns");
+      }
+      return data_[j];
+    }
+    int32_t* data_ = nullptr;
+    size_t count_column = 0;
+  };
+
+  LegacyMatrix(size_t rows, size_t column, int32_t value)
+      : count_rows(rows), count_column(column), rows_(new Row[rows]) {
+    for (size_t i = 0; i < rows; ++i) {
+      rows_[i].data_ = new int32_t[column];
+      rows_[i].count_column = column;
+      for (size_t j = 0; j < column; ++j) {
+        rows_[i].data_[j] = value;
+      }
+    }
+  }
+  LegacyMatrix(const LegacyMatrix&) = delete;
+  ~LegacyMatrix() {
+    for (size_t i = 0; i < count_rows; ++i) {
+      delete[] rows_[i].data_;
+    }
+    delete[] rows_;
+  }
+
+  Row& operator[](size_t i) const {
+    if (i >= count_rows) {
+      throw std::out_of_range("out of rows");
+    }
+    return rows_[i];
+  }
+
+  size_t count_rows, count_column;
+  Row* rows_;
+};
+
+// Like the old operator+, builds a fresh zero-filled result.
+int32_t Add(const LegacyMatrix& a, const LegacyMatrix& b) {
+  LegacyMatrix out(a.count_rows, a.count_column, 0);
+  for (size_t i = 0; i < a.count_rows; ++i) {
+    for (size_t j = 0; j < a.count_column; ++j) {
+      out[i][j] = a[i][j] + b[i][j];
+    }
+  }
+  return out[0][0];
+}
+
+void Scale(LegacyMatrix& a, int32_t num) {
+  for (size_t i = 0; i < a.count_rows; ++i) {
+    for (size_t j = 0; j < a.count_column; ++j) {
+      a[i][j] *= num;
+    }
+  }
+}
+
+bool Equal(const LegacyMatrix& a, const LegacyMatrix& b) {
+  for (size_t i = 0; i < a.count_rows; ++i) {
+    for (size_t j = 0; j < a.count_column; ++j) {
+      if (a[i][j] != b[i][j]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void Report(const char* op, size_t n, double legacy, double flat) {
+  double elements = double(n) * n;
+  std::cout << std::left << std::setw(6) << op << std::right << std::setw(6)
+            << n << std::fixed << std::setprecision(3) << std::setw(14)
+            << legacy / elements << std::setw(12) << flat / elements
+            << std::setprecision(1) << std::setw(9) << legacy / flat << "x\n";
+}
+
+void Run(size_t n) {
+  LegacyMatrix la(n, n, 1), lb(n, n, 2);
+  Matrix a(n, n, 1), b(n, n, 2);
+
+  Report("+", n, bench::BestOf(kRepeats, [&] {
+           bench::DoNotOptimize(Add(la, lb));
+         }),
+         bench::BestOf(kRepeats, [&] {
+           Matrix sum = a + b;
+           bench::DoNotOptimize(sum.data());
+         }));
+  Report("*=", n, bench::BestOf(kRepeats, [&] { Scale(la, 1); }),
+         bench::BestOf(kRepeats, [&] { a *= 1; }));
+  Report("==", n, bench::BestOf(kRepeats, [&] {
+           bench::DoNotOptimize(Equal(la, la));
+         }),
+         bench::BestOf(kRepeats, [&] { bench::DoNotOptimize(a == a); }));
+}
+
+}  // namespace
+
+int main() {
+  std::cout << "op         n  legacy ns/el  flat ns/el  speedup\n";
+  for (size_t n : {256, 1024, 4096}) {
+    Run(n);
+  }
+}
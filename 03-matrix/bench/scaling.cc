@@ -0,0 +1,67 @@
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#include "bench.hh"
+#include "matrix.hh"
+#include "parallel.hh"
+
+namespace {
+
+constexpr size_t kRepeats = 3;
+constexpr size_t kElementwise = 4096;
+constexpr size_t kProduct = 1024;
+
+struct Timings {
+  double add, scale, equal, transpose, product;
+};
+
+Timings Measure(const Matrix& a, const Matrix& b, const Matrix& sa,
+                const Matrix& sb) {
+  Matrix scaled = a;
+  Timings t;
+  t.add = bench::BestOf(kRepeats, [&] {
+    Matrix c = a + b;
+    bench::DoNotOptimize(c.data());
+  });
+  t.scale = bench::BestOf(kRepeats, [&] { scaled *= 1; });
+  t.equal = bench::BestOf(kRepeats, [&] { bench::DoNotOptimize(a == b); });
+  t.transpose = bench::BestOf(kRepeats, [&] {
+    Matrix c = a.transpose();
+    bench::DoNotOptimize(c.data());
+  });
+  t.product = bench::BestOf(kRepeats, [&] {
+    Matrix c = sa * sb;
+    bench::DoNotOptimize(c.data());
+  });
+  return t;
+}
+
+void Row(const char* name, size_t threads, double serial, double ns) {
+  std::cout << std::left << std::setw(11) << name << std::right
+            << std::setw(3) << threads << std::fixed << std::setprecision(2)
+            << std::setw(10) << ns / 1e6 << " ms" << std::setw(8)
+            << serial / ns << "x\n";
+}
+
+}  // namespace
+
+int main() {
+  Matrix a(kElementwise, kElementwise, 3), b(kElementwise, kElementwise, 3);
+  Matrix sa(kProduct, kProduct, 2), sb(kProduct, kProduct, 5);
+  std::cout << "hardware threads: " << std::thread::hardware_concurrency()
+            << "\nop     threads      time  speedup\n";
+
+  parallel::setThreads(1);
+  Timings serial = Measure(a, b, sa, sb);
+  for (size_t threads : {1, 2, 4, 8}) {
+    parallel::setThreads(threads);
+    Timings t = threads == 1 ? serial : Measure(a, b, sa, sb);
+    Row("+", threads, serial.add, t.add);
+    Row("*=", threads, serial.scale, t.scale);
+    Row("==", threads, serial.equal, t.equal);
+    Row("transpose", threads, serial.transpose, t.transpose);
+    Row("*", threads, serial.product, t.product);
+  }
+}
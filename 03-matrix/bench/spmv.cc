@@ -0,0 +1,111 @@
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "bench.hh"
+#include "matrix.hh"
+#include "sparse.hh"
+
+namespace {
+
+constexpr size_t kRepeats = 5;
+constexpr size_t kSize = 2048;
+// Columns of the dense right-hand side in the matrix products.
+constexpr size_t kWidth = 64;
+
+// kSize x kSize with roughly one element in every `every` set, scattered
+// by a fixed linear congruential sequence.
+Matrix Scattered(size_t every) {
+  Matrix m(kSize, kSize);
+  uint32_t state = 12345;
+  for (size_t i = 0; i < m.size(); ++i) {
+    state = state * 1664525 + 1013904223;
+    if ((state >> 8) % every == 0) {
+      m.data()[i] = int32_t(state >> 28) - 7;
+    }
+  }
+  return m;
+}
+
+Matrix Filled(size_t rows, size_t columns) {
+  Matrix m(rows, columns);
+  for (size_t i = 0; i < m.size(); ++i) {
+    m.data()[i] = int32_t(i % 19) - 9;
+  }
+  return m;
+}
+
+void Report(const char* name, double dense_ns, double sparse_ns) {
+  std::cout << "  " << std::left << std::setw(12) << name << std::right
+            << std::fixed << std::setprecision(3) << std::setw(10)
+            << dense_ns / 1e6 << " ms dense" << std::setw(10)
+            << sparse_ns / 1e6 << " ms sparse" << std::setprecision(1)
+            << std::setw(8) << dense_ns / sparse_ns << "x\n";
+}
+
+}  // namespace
+
+int main() {
+  Matrix rhs = Filled(kSize, kWidth), other = Filled(kSize, kSize);
+  std::vector<int32_t> x(kSize);
+  for (size_t j = 0; j < kSize; ++j) {
+    x[j] = int32_t(j % 7) - 3;
+  }
+  for (size_t every : {2, 10, 20, 100, 1000}) {
+    Matrix dense = Scattered(every);
+    CsrMatrix csr(dense);
+    CscMatrix csc(dense);
+    std::cout << kSize << " x " << kSize << ", " << std::fixed
+              << std::setprecision(2)
+              << 100.0 * csr.nonZeros() / dense.size() << "% nonzero\n";
+    Report("convert",
+           bench::BestOf(kRepeats, [&] {
+             Matrix copy = dense;
+             bench::DoNotOptimize(copy.data());
+           }),
+           bench::BestOf(kRepeats, [&] {
+             CsrMatrix converted(dense);
+             bench::DoNotOptimize(converted.values().data());
+           }));
+    // Matrix has no product with a vector, so the dense side of both SpMV
+    // rows is a plain row loop; the GEMM would pad x to a whole tile.
+    double dense_spmv = bench::BestOf(kRepeats, [&] {
+      std::vector<int32_t> y(kSize);
+      for (size_t i = 0; i < kSize; ++i) {
+        uint32_t sum = 0;
+        for (size_t j = 0; j < kSize; ++j) {
+          sum += uint32_t(dense(i, j)) * uint32_t(x[j]);
+        }
+        y[i] = int32_t(sum);
+      }
+      bench::DoNotOptimize(y.data());
+    });
+    Report("spmv csr", dense_spmv, bench::BestOf(kRepeats, [&] {
+             std::vector<int32_t> y = csr * x;
+             bench::DoNotOptimize(y.data());
+           }));
+    Report("spmv csc", dense_spmv, bench::BestOf(kRepeats, [&] {
+             std::vector<int32_t> y = csc * x;
+             bench::DoNotOptimize(y.data());
+           }));
+    Report("spmm",
+           bench::BestOf(kRepeats, [&] {
+             Matrix c = dense * rhs;
+             bench::DoNotOptimize(c.data());
+           }),
+           bench::BestOf(kRepeats, [&] {
+             Matrix c = csr * rhs;
+             bench::DoNotOptimize(c.data());
+           }));
+    Report("add",
+           bench::BestOf(kRepeats, [&] {
+             Matrix c = dense + other;
+             bench::DoNotOptimize(c.data());
+           }),
+           bench::BestOf(kRepeats, [&] {
+             Matrix c = csr + other;
+             bench::DoNotOptimize(c.data());
+           }));
+  }
+}
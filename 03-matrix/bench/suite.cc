@@ -0,0 +1,179 @@
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hh"
+#include "matrix.hh"
+#include "parallel.hh"
+
+namespace {
+
+constexpr size_t kSamples = 5;
+// Each sample repeats an operation until it runs at least this long, so
+// that the clock is not what small sizes measure.
+constexpr double kSampleNs = 5e6;
+// Operations slower than this are timed once.
+constexpr double kSlowNs = 250e6;
+// Square sizes from a few KiB, which sit in L1, to hundreds of MiB.
+constexpr size_t kSizes[] = {16, 64, 256, 1024, 4096, 8192};
+
+// Cache sizes in bytes, with typical values where the system does not say.
+struct Caches {
+  size_t l1, l2, l3;
+};
+
+Caches QueryCaches() {
+  auto query = [](int name, size_t fallback) {
+    long size = ::sysconf(name);
+    return size > 0 ? size_t(size) : fallback;
+  };
+  return {query(_SC_LEVEL1_DCACHE_SIZE, 32 << 10),
+          query(_SC_LEVEL2_CACHE_SIZE, 1 << 20),
+          query(_SC_LEVEL3_CACHE_SIZE, 32 << 20)};
+}
+
+const char* LevelOf(const Caches& caches, size_t bytes) {
+  return bytes <= caches.l1   ? "L1"
+         : bytes <= caches.l2 ? "L2"
+         : bytes <= caches.l3 ? "L3"
+                              : "DRAM";
+}
+
+// Swallows what operator<< writes, so printing is measured without the
+// cost of a terminal or of a growing string.
+class NullBuffer : public std::streambuf {
+protected:
+  int overflow(int c) override { return c; }
+  std::streamsize xsputn(const char*, std::streamsize count) override {
+    return count;
+  }
+};
+
+struct Result {
+  const char* op;
+  size_t n;
+  // Distinct bytes the operation touches, and bytes it reads plus writes.
+  size_t working_set, traffic;
+  double ns;
+};
+
+// Best time of one call over several samples.
+template <class Function>
+double Measure(Function&& function) {
+  double once = bench::BestOf(1, function);
+  if (once >= kSlowNs) {
+    return once;
+  }
+  size_t iterations = once >= kSampleNs ? 1 : size_t(kSampleNs / once) + 1;
+  return bench::BestOf(kSamples, [&] {
+           for (size_t i = 0; i < iterations; ++i) {
+             function();
+           }
+         }) /
+         double(iterations);
+}
+
+std::vector<Result> Run(size_t n) {
+  Matrix a(n, n), b(n, n), c(n, n);
+  for (size_t i = 0; i < a.size(); ++i) {
+    a.data()[i] = int32_t(i % 1000);
+    b.data()[i] = int32_t(i % 1000);
+  }
+  size_t bytes = n * n * sizeof(int32_t);
+  NullBuffer discard;
+  std::ostream null(&discard);
+  std::vector<Result> results = {
+      {"construct", n, bytes, bytes, Measure([&] {
+         Matrix m(n, n);
+         bench::DoNotOptimize(m.data());
+       })},
+      {"copy", n, 2 * bytes, 2 * bytes, Measure([&] {
+         Matrix m = a;
+         bench::DoNotOptimize(m.data());
+       })},
+      {"add", n, 3 * bytes, 3 * bytes, Measure([&] {
+         Matrix m = a + b;
+         bench::DoNotOptimize(m.data());
+       })},
+      {"add_into", n, 3 * bytes, 3 * bytes, Measure([&] {
+         c = a + b;
+         bench::DoNotOptimize(c.data());
+       })},
+      {"scale", n, bytes, 2 * bytes, Measure([&] {
+         c *= 1;
+         bench::DoNotOptimize(c.data());
+       })},
+      {"equal", n, 2 * bytes, 2 * bytes,
+       Measure([&] { bench::DoNotOptimize(a == b); })},
+      {"print", n, bytes, bytes, Measure([&] { null << a; })},
+  };
+  return results;
+}
+
+void PrintTable(const Caches& caches, const std::vector<Result>& results) {
+  std::cout << "op           size  level     ns/el     GB/s\n";
+  for (const Result& r : results) {
+    double elements = double(r.n) * r.n;
+    std::cout << std::left << std::setw(10) << r.op << std::right
+              << std::setw(7) << r.n << "  " << std::left << std::setw(5)
+              << LevelOf(caches, r.working_set) << std::right << std::fixed
+              << std::setprecision(3) << std::setw(10) << r.ns / elements
+              << std::setprecision(2) << std::setw(9) << r.traffic / r.ns
+              << '\n';
+  }
+}
+
+void PrintJson(const Caches& caches, const std::vector<Result>& results) {
+  std::cout << "{\n"
+            << "  \"element\": \"int32\",\n"
+            << "  \"hardware_threads\": "
+            << std::thread::hardware_concurrency() << ",\n"
+            << "  \"threads\": " << parallel::threads() << ",\n"
+            << "  \"caches\": {\"l1\": " << caches.l1
+            << ", \"l2\": " << caches.l2 << ", \"l3\": " << caches.l3
+            << "},\n"
+            << "  \"results\": [";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    double elements = double(r.n) * r.n;
+    std::cout << (i == 0 ? "\n" : ",\n") << "    {\"op\": \"" << r.op
+              << "\", \"rows\": " << r.n << ", \"columns\": " << r.n
+              << ", \"working_set\": " << r.working_set << ", \"level\": \""
+              << LevelOf(caches, r.working_set) << "\", "
+              << std::setprecision(6) << "\"ns_per_element\": "
+              << r.ns / elements << ", \"gb_per_s\": " << r.traffic / r.ns
+              << "}";
+  }
+  std::cout << "\n  ]\n}\n";
+}
+
+}  // namespace
+
+// Times construction, copy, +, *=, == and printing of int32 matrices from
+// L1-sized to DRAM-sized. Prints a table, or with --json the same numbers
+// as JSON for comparing releases.
+int main(int argc, char* argv[]) {
+  bool json = argc > 1 && std::strcmp(argv[1], "--json") == 0;
+  if (argc > 2 || (argc == 2 && !json)) {
+    std::cerr << "usage: " << argv[0] << " [--json]\n";
+    return 2;
+  }
+  Caches caches = QueryCaches();
+  std::vector<Result> results;
+  for (size_t n : kSizes) {
+    std::vector<Result> sized = Run(n);
+    results.insert(results.end(), sized.begin(), sized.end());
+  }
+  if (json) {
+    PrintJson(caches, results);
+  } else {
+    PrintTable(caches, results);
+  }
+}
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+
+#include "parallel.hh"
+
+template <class T>
+class BasicMatrix;
+
+template <class T>
+class BasicMatrixView;
+
+// Lazy elementwise arithmetic. a + b * 3 + c builds a small tree of nodes
+// that refer to the operands; assigning it to a matrix or a view evaluates
+// every element in one pass with no temporaries. Nodes hold references to
+// the storage they read, so keep them in expressions rather than in auto
+// variables that outlive their operands.
+namespace expr {
+
+// Elementwise kernels sweep flat storage in 64-byte tiles: the inner loop
+// has a constant trip count, so it vectorizes even at -O2, and a scalar
+// tail handles the rest.
+template <class T>
+constexpr size_t kTile = 64 / sizeof(T);
+
+class NodeBase {};
+
+template <class T>
+concept Node = std::derived_from<T, NodeBase>;
+
+// Matrices and views: operands that own or borrow row-major storage.
+template <class T>
+constexpr bool kIsStorage = false;
+
+template <class T>
+constexpr bool kIsStorage<BasicMatrix<T>> = true;
+
+template <class T>
+constexpr bool kIsStorage<BasicMatrixView<T>> = true;
+
+template <class T>
+concept Storage = kIsStorage<T>;
+
+template <class T>
+concept Operand = Node<T> || Storage<T>;
+
+// Every node reads element (i, j) through at(i, j), reports through
+// contiguous() whether all of its operands are stored without gaps between
+// rows, and through conflicts() whether writing to out while it is
+// evaluated would change what it reads.
+
+// Bounds-checked element access for nodes, so (a + b)[i][j] computes one
+// element as it did when a + b was a matrix. Throws
+// out_of_range("out of rows") or out_of_range("out of columns"). The row
+// refers to the node, so index it within the same expression.
+template <class Derived>
+class Indexed : public NodeBase {
+public:
+  class Row {
+  public:
+    Row(const Derived& node, size_t i) : node_(node), i_(i) {}
+
+    auto operator[](size_t j) const {
+      if (j >= node_.getColumns()) {
+        throw std::out_of_range("out of columns");
+      }
+      return node_.at(i_, j);
+    }
+
+  private:
+    const Derived& node_;
+    size_t i_;
+  };
+
+  Row operator[](size_t i) const {
+    const Derived& node = static_cast<const Derived&>(*this);
+    if (i >= node.getRows()) {
+      throw std::out_of_range("out of rows");
+    }
+    return Row(node, i);
+  }
+};
+
+// A matrix or view operand, read through its storage.
+template <class T>
+class Leaf : public Indexed<Leaf<T>> {
+public:
+  using value_type = T;
+
+  Leaf(const T* data, size_t rows, size_t columns, size_t stride)
+      : data_(data), rows_(rows), columns_(columns), stride_(stride) {}
+
+  size_t getRows() const { return rows_; }
+  size_t getColumns() const { return columns_; }
+  T at(size_t i, size_t j) const { return data_[i * stride_ + j]; }
+  bool contiguous() const { return stride_ == columns_; }
+
+  // Whether [begin, end), which out with stride out_stride lies in, holds
+  // an element this leaf reads at another position than the one written.
+  // Reading and writing the same element at the same position is safe.
+  bool conflicts(const T* begin, const T* end, const T* out,
+                 size_t out_stride) const {
+    if (data_ == out && stride_ == out_stride) {
+      return false;
+    }
+    size_t extent = rows_ == 0 ? 0 : (rows_ - 1) * stride_ + columns_;
+    return extent != 0 && begin < data_ + extent && data_ < end;
+  }
+
+private:
+  const T* data_;
+  size_t rows_, columns_, stride_;
+};
+
+// Narrow types are promoted for the arithmetic and wrap on the way back.
+struct Plus {
+  template <class T>
+  static T apply(T a, T b) {
+    return T(a + b);
+  }
+};
+
+struct Minus {
+  template <class T>
+  static T apply(T a, T b) {
+    return T(a - b);
+  }
+};
+
+template <Node L, Node R, class Op>
+class Binary : public Indexed<Binary<L, R, Op>> {
+public:
+  using value_type = typename L::value_type;
+  static_assert(std::is_same_v<value_type, typename R::value_type>,
+                "operands must have the same element type");
+
+  Binary(const L& left, const R& right) : left_(left), right_(right) {
+    if (left.getRows() != right.getRows() ||
+        left.getColumns() != right.getColumns()) {
+      throw std::runtime_error("matrix not equal");
+    }
+  }
+
+  size_t getRows() const { return left_.getRows(); }
+  size_t getColumns() const { return left_.getColumns(); }
+  value_type at(size_t i, size_t j) const {
+    return Op::apply(left_.at(i, j), right_.at(i, j));
+  }
+  bool contiguous() const { return left_.contiguous() && right_.contiguous(); }
+  bool conflicts(const value_type* begin, const value_type* end,
+                 const value_type* out, size_t out_stride) const {
+    return left_.conflicts(begin, end, out, out_stride) ||
+           right_.conflicts(begin, end, out, out_stride);
+  }
+
+private:
+  L left_;
+  R right_;
+};
+
+template <Node E>
+class Scaled : public Indexed<Scaled<E>> {
+public:
+  using value_type = typename E::value_type;
+
+  Scaled(const E& node, value_type factor) : node_(node), factor_(factor) {}
+
+  size_t getRows() const { return node_.getRows(); }
+  size_t getColumns() const { return node_.getColumns(); }
+  value_type at(size_t i, size_t j) const {
+    return value_type(node_.at(i, j) * factor_);
+  }
+  bool contiguous() const { return node_.contiguous(); }
+  bool conflicts(const value_type* begin, const value_type* end,
+                 const value_type* out, size_t out_stride) const {
+    return node_.conflicts(begin, end, out, out_stride);
+  }
+
+private:
+  E node_;
+  value_type factor_;
+};
+
+template <Operand T>
+auto AsNode(const T& operand) {
+  if constexpr (Node<T>) {
+    return operand;
+  } else {
+    return Leaf<typename T::value_type>(operand.data(), operand.getRows(),
+                                        operand.getColumns(),
+                                        operand.stride());
+  }
+}
+
+template <Operand T>
+using NodeOf = decltype(AsNode(std::declval<const T&>()));
+
+template <Operand T>
+using ValueOf = typename NodeOf<T>::value_type;
+
+// Writes element (i, j) of node to out[i * out_stride + j], tile by tile,
+// on the thread pool. Each tile is computed into a local buffer first,
+// which the compiler knows aliases nothing, so both loops vectorize without
+// runtime overlap checks. When node and out are both gapless the matrix is
+// swept as one long row. Callers make sure out does not conflict with what
+// node reads.
+template <Node E>
+void Evaluate(const E& node, typename E::value_type* out, size_t out_stride) {
+  using T = typename E::value_type;
+  constexpr size_t tile_size = kTile<T>;
+  size_t rows = node.getRows(), columns = node.getColumns();
+  // Element (i, j) of the flattened matrix is at(0, i * columns + j), as a
+  // gapless leaf's stride equals its column count.
+  bool flat = node.contiguous() && out_stride == columns;
+  auto row = [&](size_t i, size_t begin, size_t end) {
+    T* to = out + i * out_stride;
+    size_t j = begin;
+    for (; j + tile_size <= end; j += tile_size) {
+      T tile[tile_size];
+      for (size_t k = 0; k < tile_size; ++k) {
+        tile[k] = node.at(i, j + k);
+      }
+      for (size_t k = 0; k < tile_size; ++k) {
+        to[j + k] = tile[k];
+      }
+    }
+    for (; j < end; ++j) {
+      to[j] = node.at(i, j);
+    }
+  };
+  size_t n = rows * columns;
+  if (flat) {
+    parallel::parallelFor(n, tile_size, n, [&](size_t begin, size_t end) {
+      row(0, begin, end);
+    });
+  } else {
+    parallel::parallelFor(rows, 1, n, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        row(i, 0, columns);
+      }
+    });
+  }
+}
+
+// Prints an expression as the matrix it evaluates to, so std::cout << a + b
+// works as it did when a + b was a matrix. Found by argument-dependent
+// lookup like the hidden friend of BasicMatrix.
+template <Node E>
+std::ostream& operator<<(std::ostream& os, const E& node) {
+  return os << BasicMatrix<typename E::value_type>(node);
+}
+
+}  // namespace expr
+
+// Elementwise sum and difference. Throw runtime_error("matrix not equal")
+// when the shapes differ.
+template <expr::Operand L, expr::Operand R>
+auto operator+(const L& left, const R& right) {
+  return expr::Binary<expr::NodeOf<L>, expr::NodeOf<R>, expr::Plus>(
+      expr::AsNode(left), expr::AsNode(right));
+}
+
+template <expr::Operand L, expr::Operand R>
+auto operator-(const L& left, const R& right) {
+  return expr::Binary<expr::NodeOf<L>, expr::NodeOf<R>, expr::Minus>(
+      expr::AsNode(left), expr::AsNode(right));
+}
+
+// Multiplication by a scalar; matrix * matrix is the product in matrix.hh.
+template <expr::Operand T>
+auto operator*(const T& operand, expr::ValueOf<T> factor) {
+  return expr::Scaled<expr::NodeOf<T>>(expr::AsNode(operand), factor);
+}
+
+template <expr::Operand T>
+auto operator*(expr::ValueOf<T> factor, const T& operand) {
+  return operand * factor;
+}
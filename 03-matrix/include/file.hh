@@ -0,0 +1,186 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "matrix.hh"
+
+// Binary matrix files. A file is a 64-byte MatrixFileHeader followed, at
+// header.data_offset, by the rows x columns elements in row-major order and
+// host byte order. data_offset is a multiple of header.alignment, so a
+// mapped file is used as it is, without parsing or copying. The header
+// records the byte order of the writer, and hosts of the other one refuse
+// the file rather than read its numbers swapped.
+
+// Element type codes stored in the header.
+enum class ElementType : uint32_t {
+  kInt8 = 1,
+  kInt32 = 2,
+  kInt64 = 3,
+  kFloat = 4,
+  kDouble = 5,
+};
+
+template <class T>
+constexpr ElementType kElementType = ElementType(0);
+template <>
+constexpr ElementType kElementType<int8_t> = ElementType::kInt8;
+template <>
+constexpr ElementType kElementType<int32_t> = ElementType::kInt32;
+template <>
+constexpr ElementType kElementType<int64_t> = ElementType::kInt64;
+template <>
+constexpr ElementType kElementType<float> = ElementType::kFloat;
+template <>
+constexpr ElementType kElementType<double> = ElementType::kDouble;
+
+// Elements start on a cache line unless the writer asks otherwise.
+constexpr size_t kMatrixFileAlignment = 64;
+
+struct MatrixFileHeader {
+  static constexpr char kMagic[8] = {'M', 'A', 'T', 'R', 'I', 'X', 0, 0};
+  static constexpr uint32_t kVersion = 2;
+  // Reads as 0x04030201 on a host of the opposite byte order.
+  static constexpr uint32_t kByteOrder = 0x01020304;
+
+  char magic[8];
+  uint32_t byte_order;
+  uint32_t version;
+  ElementType type;
+  uint32_t element_size;
+  uint32_t alignment;
+  uint32_t reserved;
+  uint64_t rows;
+  uint64_t columns;
+  uint64_t data_offset;
+  // MatrixChecksum of the element bytes.
+  uint64_t checksum;
+};
+
+static_assert(sizeof(MatrixFileHeader) == 64);
+
+// Fletcher-style checksum without the modulus: the data is read as 64-bit
+// words, zero-padded at the end, and both their sum and the sum of the
+// running sums are kept, so flipped bits and reordered words both show.
+// The data may arrive in pieces of any length.
+class MatrixChecksum {
+public:
+  void update(const void* data, size_t bytes);
+  uint64_t value() const;
+
+private:
+  uint64_t sum_ = 0, running_ = 0;
+  // Bytes of a word split between two updates.
+  uint64_t partial_ = 0;
+  size_t partial_bytes_ = 0;
+};
+
+// Writes a rows x column matrix a block of rows at a time, so the whole
+// matrix never has to be in memory. The header is written last: a file
+// whose writer did not finish() does not load.
+template <class T>
+class MatrixWriter {
+public:
+  // Creates or truncates path. alignment must be a power of two no smaller
+  // than alignof(T); throws invalid_argument("invalid alignment")
+  // otherwise, and system_error when the file cannot be created.
+  MatrixWriter(const std::string& path, size_t rows, size_t column,
+               size_t alignment = kMatrixFileAlignment);
+  MatrixWriter(const MatrixWriter&) = delete;
+  MatrixWriter& operator=(const MatrixWriter&) = delete;
+  ~MatrixWriter();
+
+  // Appends the rows of block. Throws runtime_error("matrix not equal") when
+  // its column count differs from the file's, out_of_range("out of rows")
+  // when the file has no room for them, and system_error when writing
+  // fails. Small rows are gathered into large writes.
+  void write(BasicMatrixView<const T> block);
+
+  // Writes the header and closes the file. Throws
+  // runtime_error("matrix file incomplete") while rows are missing.
+  void finish();
+
+private:
+  void Put(const void* data, size_t bytes);
+  void Flush();
+  void WriteAll(const void* data, size_t bytes);
+
+  std::string path_;
+  int fd_;
+  size_t count_rows, count_column, written_rows = 0;
+  MatrixFileHeader header_;
+  MatrixChecksum checksum_;
+  std::vector<char> buffer_;
+  size_t buffered_ = 0;
+};
+
+// A matrix file mapped read-only. Opening reads only the header; elements
+// are paged in from the file as they are touched, so a matrix of any size
+// opens in constant time. Move-only; views of it must not outlive it.
+template <class T>
+class MappedMatrix {
+public:
+  // Throws system_error when path cannot be opened or mapped,
+  // runtime_error("matrix byte order mismatch") when the file was written
+  // on a host of the other byte order, runtime_error("invalid matrix file")
+  // when the header is malformed or disagrees with the file size, and
+  // runtime_error("matrix type mismatch") when the file holds other
+  // elements than T. With populate set, the whole
+  // file is read in at once, which is cheaper than faulting in every page
+  // when all of it will be used.
+  explicit MappedMatrix(const std::string& path, bool populate = false);
+  // Leaves other empty (0 x 0).
+  MappedMatrix(MappedMatrix&& other) noexcept;
+  MappedMatrix& operator=(MappedMatrix&& other) noexcept;
+  ~MappedMatrix();
+
+  size_t getRows() const { return header_.rows; }
+  size_t getColumns() const { return header_.columns; }
+  const MatrixFileHeader& header() const { return header_; }
+
+  BasicMatrixView<const T> view() const {
+    return BasicMatrixView<const T>(
+        reinterpret_cast<const T*>(static_cast<const char*>(mapping_) +
+                                   header_.data_offset),
+        header_.rows, header_.columns, header_.columns);
+  }
+
+  // Recomputes the checksum of the elements, reading all of them.
+  bool verify() const;
+
+private:
+  void* mapping_ = nullptr;
+  size_t length_ = 0;
+  MatrixFileHeader header_;
+};
+
+// Writes a matrix or view to path in one go.
+template <expr::Storage M>
+void saveMatrix(const std::string& path, const M& matrix) {
+  using T = typename M::value_type;
+  MatrixWriter<T> writer(path, matrix.getRows(), matrix.getColumns());
+  writer.write(BasicMatrixView<const T>(matrix));
+  writer.finish();
+}
+
+// Reads a matrix file into a new matrix: the file is mapped and its
+// elements copied, nothing is parsed. Throws like MappedMatrix.
+template <class T>
+BasicMatrix<T> loadMatrix(const std::string& path) {
+  MappedMatrix<T> mapped(path, true);
+  return BasicMatrix<T>(mapped.view());
+}
+
+extern template class MatrixWriter<int8_t>;
+extern template class MatrixWriter<int32_t>;
+extern template class MatrixWriter<int64_t>;
+extern template class MatrixWriter<float>;
+extern template class MatrixWriter<double>;
+
+extern template class MappedMatrix<int8_t>;
+extern template class MappedMatrix<int32_t>;
+extern template class MappedMatrix<int64_t>;
+extern template class MappedMatrix<float>;
+extern template class MappedMatrix<double>;
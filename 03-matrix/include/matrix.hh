@@ -3,45 +3,309 @@
 #include <cstddef>
 #include <cstdint>
 #include <iostream>
+#include <type_traits>
 #include <vector>
 
-class Matrix {
+#include "expression.hh"
+
+// Element type of the product of two BasicMatrix<T>. int8 matrices multiply
+// into int32 so their dot products do not overflow after a few terms.
+template <class T>
+using ProductOf = std::conditional_t<std::is_same_v<T, int8_t>, int32_t, T>;
+
+// Matrix product of two matrices or views. Throws
+// runtime_error("matrix not multipliable") when m1.getColumns() !=
+// m2.getRows(); integer overflow wraps.
+template <class T>
+BasicMatrix<ProductOf<T>> multiply(BasicMatrixView<const T> m1,
+                                   BasicMatrixView<const T> m2);
+
+// What == and << do for matrices and views.
+template <class T>
+bool equal(BasicMatrixView<const T> m1, BasicMatrixView<const T> m2);
+template <class T>
+std::ostream& print(std::ostream& os, BasicMatrixView<const T> matrix);
+
+// Writes the transpose of from into to, which must be from.getColumns() x
+// from.getRows() and must not overlap it. The matrix is halved along its
+// longer side until the pieces fit in cache, whatever the cache sizes are.
+template <class T>
+void transposeTo(BasicMatrixView<const T> from, BasicMatrixView<T> to);
+
+// Transposes a square matrix in place by swapping mirrored blocks, halved
+// the same way. Throws runtime_error("matrix not square") otherwise.
+template <class T>
+void transposeSquare(BasicMatrixView<T> matrix);
+
+// Row-major matrix stored in one contiguous block, instantiated for int8_t,
+// int32_t, int64_t, float and double. +, - and scalar * build lazy
+// expressions (expression.hh) that are evaluated on assignment. Large
+// operations run on the shared thread pool configured in parallel.hh.
+template <class T>
+class BasicMatrix {
 private:
+  // Bounds-checked view of one row, returned by value from operator[].
   class ProxyRow {
   public:
-    ProxyRow() = default;
-    ProxyRow(size_t column, int32_t standart_value = 0);
-    ~ProxyRow();
+    ProxyRow(T* data, size_t column);
+
+    T& operator[](size_t j) const;
 
-    int32_t& operator[](size_t j);
-    int32_t* data_;
+  private:
+    T* data_;
     size_t count_column;
   };
 
 public:
-  Matrix(size_t rows = 1, size_t column = 1, int32_t standart_value = 0);
-  Matrix(const Matrix& matrix);
-  Matrix(const std::vector<std::vector<int32_t> >& vec);
-  Matrix(Matrix&& matrix);
+  using value_type = T;
+
+  BasicMatrix(size_t rows = 1, size_t column = 1, T standart_value = 0);
+  BasicMatrix(const BasicMatrix& matrix);
+  BasicMatrix(const std::vector<std::vector<T> >& vec);
+  // Leaves matrix empty (0 x 0).
+  BasicMatrix(BasicMatrix&& matrix) noexcept;
+  // Copies the elements of a view. A template, so that braced lists never
+  // pick it through a view of a temporary matrix.
+  template <class V>
+    requires std::is_same_v<V, BasicMatrixView<T>> ||
+             std::is_same_v<V, BasicMatrixView<const T>>
+  explicit BasicMatrix(const V& view)
+      : BasicMatrix(view.getRows(), view.getColumns(), Uninitialized()) {
+    expr::Evaluate(expr::AsNode(view), data_, count_column);
+  }
+
+  // Evaluates a lazy elementwise expression such as a + b * 3 + c.
+  template <expr::Node E>
+  BasicMatrix(const E& node)
+      : BasicMatrix(node.getRows(), node.getColumns(), Uninitialized()) {
+    expr::Evaluate(node, data_, count_column);
+  }
 
-  void operator=(const Matrix& matrix);
+  // Assignments reuse the current storage whenever it holds the same number
+  // of elements, so assigning into a matrix of the final shape never
+  // allocates.
+  BasicMatrix& operator=(const BasicMatrix& matrix);
+  BasicMatrix& operator=(BasicMatrix&& matrix) noexcept;
 
-  ~Matrix();
+  template <expr::Node E>
+  BasicMatrix& operator=(const E& node) {
+    // Reading this matrix through a view of other elements, or in a shape
+    // that Reshape changes, needs the result built aside first.
+    bool same_shape = node.getRows() == count_rows &&
+                      node.getColumns() == count_column;
+    if (node.conflicts(data_, data_ + size(), same_shape ? data_ : nullptr,
+                       count_column)) {
+      return *this = BasicMatrix(node);
+    }
+    Reshape(node.getRows(), node.getColumns());
+    expr::Evaluate(node, data_, count_column);
+    return *this;
+  }
+
+  // In place; throw runtime_error("matrix not equal") on a shape mismatch.
+  template <expr::Operand E>
+  BasicMatrix& operator+=(const E& other) {
+    return *this = *this + other;
+  }
+  template <expr::Operand E>
+  BasicMatrix& operator-=(const E& other) {
+    return *this = *this - other;
+  }
+
+  ~BasicMatrix();
 
   size_t getRows() const;
   size_t getColumns() const;
-  
-  friend Matrix operator+(const Matrix& m1, const Matrix& m2);
+  size_t size() const { return count_rows * count_column; }
+  // Elements between the starts of two rows.
+  size_t stride() const { return count_column; }
+
+  BasicMatrix& operator*=(T num);
+
+  // Returns the getColumns() x getRows() transpose.
+  BasicMatrix transpose() const;
+  // Transposes in place; only a non-square matrix needs new storage.
+  void transposeInPlace();
 
-  Matrix& operator*=(int32_t num);
+  ProxyRow operator[](size_t i) const;
 
-  ProxyRow& operator[](size_t i) const;
+  // Unchecked element access and raw storage for hot loops.
+  T& operator()(size_t i, size_t j) { return data_[i * count_column + j]; }
+  T operator()(size_t i, size_t j) const {
+    return data_[i * count_column + j];
+  }
+  T* data() { return data_; }
+  const T* data() const { return data_; }
+
+  // Views of the whole matrix, of rows [begin, end), of columns
+  // [begin, end), and of the rows x column block whose top left element is
+  // (row, col). See view.hh.
+  BasicMatrixView<T> view() { return BasicMatrixView<T>(*this); }
+  BasicMatrixView<const T> view() const {
+    return BasicMatrixView<const T>(*this);
+  }
+  BasicMatrixView<T> rows(size_t begin, size_t end) {
+    return view().rows(begin, end);
+  }
+  BasicMatrixView<const T> rows(size_t begin, size_t end) const {
+    return view().rows(begin, end);
+  }
+  BasicMatrixView<T> columns(size_t begin, size_t end) {
+    return view().columns(begin, end);
+  }
+  BasicMatrixView<const T> columns(size_t begin, size_t end) const {
+    return view().columns(begin, end);
+  }
+  BasicMatrixView<T> block(size_t row, size_t col, size_t rows,
+                           size_t column) {
+    return view().block(row, col, rows, column);
+  }
+  BasicMatrixView<const T> block(size_t row, size_t col, size_t rows,
+                                 size_t column) const {
+    return view().block(row, col, rows, column);
+  }
+
+  // Found through argument-dependent lookup, so an expression on one side
+  // converts to a matrix as it did before BasicMatrix was a template.
+  friend BasicMatrix<ProductOf<T>> operator*(const BasicMatrix& m1,
+                                             const BasicMatrix& m2) {
+    return multiply<T>(m1, m2);
+  }
+  friend bool operator==(const BasicMatrix& m1, const BasicMatrix& m2) {
+    return equal<T>(m1, m2);
+  }
+  friend bool operator!=(const BasicMatrix& m1, const BasicMatrix& m2) {
+    return !equal<T>(m1, m2);
+  }
+  friend std::ostream& operator<<(std::ostream& os,
+                                  const BasicMatrix& matrix) {
+    return print<T>(os, matrix);
+  }
 
 protected:
+  // Views build their transposes, and multiplyChecked its result, without
+  // zero-filling them first.
+  friend class BasicMatrixView<T>;
+  friend class BasicMatrixView<const T>;
+  friend BasicMatrix<int32_t> multiplyChecked(const BasicMatrix<int32_t>& m1,
+                                              const BasicMatrix<int32_t>& m2);
+
+  // Tag for a constructor that leaves the elements unset.
+  struct Uninitialized {};
+  BasicMatrix(size_t rows, size_t column, Uninitialized);
+
+  // Gives the matrix the new shape. Storage, and with it the elements, is
+  // kept when the element count does not change; otherwise the elements are
+  // left unset.
+  void Reshape(size_t rows, size_t column);
+
   size_t count_rows, count_column;
-  ProxyRow* rows_ = nullptr;
+  T* data_ = nullptr;
 };
 
-std::ostream& operator<<(std::ostream& os, const Matrix& matrix);
-bool operator==(const Matrix& m1, const Matrix& m2);
-bool operator!=(const Matrix& m1, const Matrix& m2);
+using Matrix = BasicMatrix<int32_t>;
+
+// Same product as operator* accumulated in int64; throws
+// overflow_error("matrix overflow") if an element of the result does not fit
+// in int32_t.
+Matrix multiplyChecked(const Matrix& m1, const Matrix& m2);
+
+namespace expr {
+
+// An operand as storage: nodes are evaluated into a matrix, which lives
+// until the end of the full expression; matrices and views pass through.
+template <Operand T>
+decltype(auto) Evaluated(const T& operand) {
+  if constexpr (Node<T>) {
+    return BasicMatrix<typename T::value_type>(operand);
+  } else {
+    return (operand);
+  }
+}
+
+template <class L, class R>
+concept NodePair = Operand<L> && Operand<R> && (Node<L> || Node<R>) &&
+                   std::is_same_v<ValueOf<L>, ValueOf<R>>;
+
+// ==, != and the matrix product with an expression on either side evaluate
+// it and delegate, so (a + b) * (a - b) and a + b != c work as they did
+// when a + b was a matrix.
+template <class L, class R>
+  requires NodePair<L, R>
+bool operator==(const L& left, const R& right) {
+  return equal<ValueOf<L>>(Evaluated(left), Evaluated(right));
+}
+
+template <class L, class R>
+  requires NodePair<L, R>
+bool operator!=(const L& left, const R& right) {
+  return !(left == right);
+}
+
+template <class L, class R>
+  requires NodePair<L, R>
+BasicMatrix<ProductOf<ValueOf<L>>> operator*(const L& left, const R& right) {
+  return multiply<ValueOf<L>>(Evaluated(left), Evaluated(right));
+}
+
+}  // namespace expr
+
+// BasicMatrixView, returned by view(), rows(), columns() and block().
+#include "view.hh"
+
+extern template class BasicMatrix<int8_t>;
+extern template class BasicMatrix<int32_t>;
+extern template class BasicMatrix<int64_t>;
+extern template class BasicMatrix<float>;
+extern template class BasicMatrix<double>;
+
+extern template BasicMatrix<int32_t> multiply(BasicMatrixView<const int8_t>,
+                                              BasicMatrixView<const int8_t>);
+extern template BasicMatrix<int32_t> multiply(BasicMatrixView<const int32_t>,
+                                              BasicMatrixView<const int32_t>);
+extern template BasicMatrix<int64_t> multiply(BasicMatrixView<const int64_t>,
+                                              BasicMatrixView<const int64_t>);
+extern template BasicMatrix<float> multiply(BasicMatrixView<const float>,
+                                            BasicMatrixView<const float>);
+extern template BasicMatrix<double> multiply(BasicMatrixView<const double>,
+                                             BasicMatrixView<const double>);
+
+extern template bool equal(BasicMatrixView<const int8_t>,
+                           BasicMatrixView<const int8_t>);
+extern template std::ostream& print(std::ostream&,
+                                    BasicMatrixView<const int8_t>);
+extern template void transposeTo(BasicMatrixView<const int8_t>,
+                                 BasicMatrixView<int8_t>);
+extern template void transposeSquare(BasicMatrixView<int8_t>);
+
+extern template bool equal(BasicMatrixView<const int32_t>,
+                           BasicMatrixView<const int32_t>);
+extern template std::ostream& print(std::ostream&,
+                                    BasicMatrixView<const int32_t>);
+extern template void transposeTo(BasicMatrixView<const int32_t>,
+                                 BasicMatrixView<int32_t>);
+extern template void transposeSquare(BasicMatrixView<int32_t>);
+
+extern template bool equal(BasicMatrixView<const int64_t>,
+                           BasicMatrixView<const int64_t>);
+extern template std::ostream& print(std::ostream&,
+                                    BasicMatrixView<const int64_t>);
+extern template void transposeTo(BasicMatrixView<const int64_t>,
+                                 BasicMatrixView<int64_t>);
+extern template void transposeSquare(BasicMatrixView<int64_t>);
+
+extern template bool equal(BasicMatrixView<const float>,
+                           BasicMatrixView<const float>);
+extern template std::ostream& print(std::ostream&,
+                                    BasicMatrixView<const float>);
+extern template void transposeTo(BasicMatrixView<const float>,
+                                 BasicMatrixView<float>);
+extern template void transposeSquare(BasicMatrixView<float>);
+
+extern template bool equal(BasicMatrixView<const double>,
+                           BasicMatrixView<const double>);
+extern template std::ostream& print(std::ostream&,
+                                    BasicMatrixView<const double>);
+extern template void transposeTo(BasicMatrixView<const double>,
+                                 BasicMatrixView<double>);
+extern template void transposeSquare(BasicMatrixView<double>);
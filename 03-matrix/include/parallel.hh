@@ -0,0 +1,93 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace parallel {
+
+template <class Signature>
+class FunctionRef;
+
+// Non-owning reference to a callable. Unlike std::function it never
+// allocates, so handing a lambda to the pool is free; the callable must
+// outlive the call it is passed to.
+template <class Result, class... Args>
+class FunctionRef<Result(Args...)> {
+public:
+  template <class Function>
+    requires(!std::is_same_v<std::remove_cvref_t<Function>, FunctionRef>)
+  FunctionRef(Function&& function)
+      : object_(const_cast<void*>(
+            static_cast<const void*>(std::addressof(function)))),
+        call_([](void* object, Args... args) -> Result {
+          return (*static_cast<std::remove_reference_t<Function>*>(object))(
+              std::forward<Args>(args)...);
+        }) {}
+
+  Result operator()(Args... args) const {
+    return call_(object_, std::forward<Args>(args)...);
+  }
+
+private:
+  void* object_;
+  Result (*call_)(void*, Args...);
+};
+
+// Fixed set of worker threads that run indexed tasks. The calling thread
+// takes part, so a pool of size n spawns n - 1 workers.
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t threads);
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ~ThreadPool();
+
+  size_t size() const { return workers_.size() + 1; }
+
+  // Calls task(i) for every i < tasks and waits for all of them. The first
+  // exception thrown by a task is rethrown here once the rest have stopped.
+  // Called from inside a task, it runs serially instead of deadlocking.
+  void run(size_t tasks, FunctionRef<void(size_t)> task);
+
+private:
+  void work();
+  void drain();
+
+  std::vector<std::thread> workers_;
+  std::mutex run_mutex_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  const FunctionRef<void(size_t)>* task_ = nullptr;
+  size_t tasks_ = 0;
+  size_t next_ = 0;
+  size_t busy_ = 0;
+  uint64_t generation_ = 0;
+  bool stop_ = false;
+  std::exception_ptr error_;
+};
+
+// Threads used by Matrix operations; 0 means hardware_concurrency().
+// The default is 0, and 1 makes every operation serial. Do not change it
+// while another thread is running a Matrix operation.
+void setThreads(size_t threads);
+size_t threads();
+
+// Operations doing fewer element operations than this stay serial.
+void setThreshold(size_t work);
+size_t threshold();
+
+// Calls body(begin, end) on disjoint pieces covering [0, count), each
+// starting at a multiple of grain. Runs on the shared pool when work, the
+// total element operations, reaches threshold(), and serially otherwise.
+void parallelFor(size_t count, size_t grain, size_t work,
+                 FunctionRef<void(size_t, size_t)> body);
+
+}  // namespace parallel
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "matrix.hh"
+
+// Compressed storage shared by the CSR and CSC layouts. Each major line (a
+// row in CSR, a column in CSC) owns the nonzeros k with
+// offsets()[line] <= k < offsets()[line + 1]: values()[k] sits at minor
+// position indices()[k]. Indices are 32-bit to halve the index traffic of
+// every sweep, so the minor dimension must be below 2^32.
+template <class T>
+class CompressedStorage {
+public:
+  using value_type = T;
+
+  size_t getRows() const { return count_rows; }
+  size_t getColumns() const { return count_column; }
+  size_t nonZeros() const { return values_.size(); }
+
+  const std::vector<size_t>& offsets() const { return offsets_; }
+  const std::vector<uint32_t>& indices() const { return indices_; }
+  const std::vector<T>& values() const { return values_; }
+
+protected:
+  // All zero. Throws length_error("matrix too large for sparse indices")
+  // when minor does not fit the index type.
+  CompressedStorage(size_t rows, size_t column, size_t major, size_t minor);
+  // Takes the arrays as they are after checking that they describe a
+  // major x minor matrix; throws invalid_argument("invalid sparse
+  // structure") otherwise. Indices need not be sorted, and repeated ones
+  // add up.
+  CompressedStorage(size_t rows, size_t column, size_t major, size_t minor,
+                    std::vector<size_t> offsets, std::vector<uint32_t> indices,
+                    std::vector<T> values);
+
+  size_t count_rows, count_column;
+  std::vector<size_t> offsets_;
+  std::vector<uint32_t> indices_;
+  std::vector<T> values_;
+};
+
+template <class T>
+class BasicCscMatrix;
+
+// Compressed sparse row matrix. Cheap to build from a dense matrix and to
+// multiply by dense vectors and matrices; the product with a vector is
+// spread over the thread pool in pieces holding equal numbers of nonzeros.
+template <class T>
+class BasicCsrMatrix : public CompressedStorage<T> {
+public:
+  // rows x column, all zero.
+  BasicCsrMatrix(size_t rows = 1, size_t column = 1);
+  // From raw CSR arrays; offsets has rows + 1 entries.
+  BasicCsrMatrix(size_t rows, size_t column, std::vector<size_t> offsets,
+                 std::vector<uint32_t> indices, std::vector<T> values);
+  // Keeps the elements that are not zero, in row-major order.
+  explicit BasicCsrMatrix(const BasicMatrix<T>& dense);
+  explicit BasicCsrMatrix(const BasicCscMatrix<T>& csc);
+
+  BasicMatrix<T> toDense() const;
+
+  // dense += sparse touches only the nonzeros; + copies dense first. Both
+  // throw runtime_error("matrix not equal") when the shapes differ.
+  friend BasicMatrix<T>& operator+=(BasicMatrix<T>& dense,
+                                    const BasicCsrMatrix& sparse) {
+    AddTo(dense, sparse);
+    return dense;
+  }
+  friend BasicMatrix<T> operator+(const BasicCsrMatrix& sparse,
+                                  const BasicMatrix<T>& dense) {
+    BasicMatrix<T> res = dense;
+    AddTo(res, sparse);
+    return res;
+  }
+  friend BasicMatrix<T> operator+(const BasicMatrix<T>& dense,
+                                  const BasicCsrMatrix& sparse) {
+    return sparse + dense;
+  }
+
+  // Sparse matrix times dense vector and sparse times dense matrix. Throw
+  // runtime_error("matrix not multipliable") on a shape mismatch; integer
+  // overflow wraps, as in the dense product.
+  friend std::vector<ProductOf<T>> operator*(const BasicCsrMatrix& sparse,
+                                             const std::vector<T>& x) {
+    return MultiplyVector(sparse, x);
+  }
+  friend BasicMatrix<ProductOf<T>> operator*(const BasicCsrMatrix& sparse,
+                                             const BasicMatrix<T>& dense) {
+    return MultiplyMatrix(sparse, dense);
+  }
+
+private:
+  static void AddTo(BasicMatrix<T>& dense, const BasicCsrMatrix& sparse);
+  static std::vector<ProductOf<T>> MultiplyVector(const BasicCsrMatrix& sparse,
+                                                  const std::vector<T>& x);
+  static BasicMatrix<ProductOf<T>> MultiplyMatrix(const BasicCsrMatrix& sparse,
+                                                  const BasicMatrix<T>& dense);
+};
+
+// Compressed sparse column matrix. Its natural products are a dense matrix
+// times the sparse one, which reads whole columns, and the sparse one times
+// a vector, which scatters each column into the result and stays serial.
+template <class T>
+class BasicCscMatrix : public CompressedStorage<T> {
+public:
+  // rows x column, all zero.
+  BasicCscMatrix(size_t rows = 1, size_t column = 1);
+  // From raw CSC arrays; offsets has column + 1 entries.
+  BasicCscMatrix(size_t rows, size_t column, std::vector<size_t> offsets,
+                 std::vector<uint32_t> indices, std::vector<T> values);
+  // Keeps the elements that are not zero, in column-major order.
+  explicit BasicCscMatrix(const BasicMatrix<T>& dense);
+  explicit BasicCscMatrix(const BasicCsrMatrix<T>& csr);
+
+  BasicMatrix<T> toDense() const;
+
+  // Same contracts as for BasicCsrMatrix.
+  friend BasicMatrix<T>& operator+=(BasicMatrix<T>& dense,
+                                    const BasicCscMatrix& sparse) {
+    AddTo(dense, sparse);
+    return dense;
+  }
+  friend BasicMatrix<T> operator+(const BasicCscMatrix& sparse,
+                                  const BasicMatrix<T>& dense) {
+    BasicMatrix<T> res = dense;
+    AddTo(res, sparse);
+    return res;
+  }
+  friend BasicMatrix<T> operator+(const BasicMatrix<T>& dense,
+                                  const BasicCscMatrix& sparse) {
+    return sparse + dense;
+  }
+
+  friend std::vector<ProductOf<T>> operator*(const BasicCscMatrix& sparse,
+                                             const std::vector<T>& x) {
+    return MultiplyVector(sparse, x);
+  }
+  friend BasicMatrix<ProductOf<T>> operator*(const BasicMatrix<T>& dense,
+                                             const BasicCscMatrix& sparse) {
+    return MultiplyMatrix(dense, sparse);
+  }
+
+private:
+  static void AddTo(BasicMatrix<T>& dense, const BasicCscMatrix& sparse);
+  static std::vector<ProductOf<T>> MultiplyVector(const BasicCscMatrix& sparse,
+                                                  const std::vector<T>& x);
+  static BasicMatrix<ProductOf<T>> MultiplyMatrix(const BasicMatrix<T>& dense,
+                                                  const BasicCscMatrix& sparse);
+};
+
+using CsrMatrix = BasicCsrMatrix<int32_t>;
+using CscMatrix = BasicCscMatrix<int32_t>;
+
+extern template class CompressedStorage<int8_t>;
+extern template class CompressedStorage<int32_t>;
+extern template class CompressedStorage<int64_t>;
+extern template class CompressedStorage<float>;
+extern template class CompressedStorage<double>;
+
+extern template class BasicCsrMatrix<int8_t>;
+extern template class BasicCsrMatrix<int32_t>;
+extern template class BasicCsrMatrix<int64_t>;
+extern template class BasicCsrMatrix<float>;
+extern template class BasicCsrMatrix<double>;
+
+extern template class BasicCscMatrix<int8_t>;
+extern template class BasicCscMatrix<int32_t>;
+extern template class BasicCscMatrix<int64_t>;
+extern template class BasicCscMatrix<float>;
+extern template class BasicCscMatrix<double>;
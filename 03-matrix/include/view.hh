@@ -0,0 +1,190 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <type_traits>
+
+#include "expression.hh"
+#include "matrix.hh"
+
+// Non-owning window onto row-major storage: rows x columns elements, row i
+// starting stride elements after row i - 1. BasicMatrixView<const T> only
+// reads; BasicMatrixView<T> also writes through. Views are cheap to copy
+// and must not outlive the matrix they look at. They take part in the
+// lazy arithmetic of expression.hh, compare, print and multiply like
+// matrices, and assigning to a writable view writes its elements.
+template <class T>
+class BasicMatrixView {
+public:
+  using value_type = std::remove_const_t<T>;
+
+  BasicMatrixView(T* data, size_t rows, size_t column, size_t stride)
+      : data_(data), count_rows(rows), count_column(column), stride_(stride) {}
+
+  // The whole of a matrix.
+  BasicMatrixView(BasicMatrix<value_type>& matrix)
+      : BasicMatrixView(matrix.data(), matrix.getRows(), matrix.getColumns(),
+                        matrix.stride()) {}
+  BasicMatrixView(const BasicMatrix<value_type>& matrix)
+    requires std::is_const_v<T>
+      : BasicMatrixView(matrix.data(), matrix.getRows(), matrix.getColumns(),
+                        matrix.stride()) {}
+
+  // A writable view also reads.
+  BasicMatrixView(const BasicMatrixView<value_type>& view)
+    requires std::is_const_v<T>
+      : BasicMatrixView(view.data(), view.getRows(), view.getColumns(),
+                        view.stride()) {}
+
+  BasicMatrixView(const BasicMatrixView&) = default;
+
+  // Assignments write the elements, not the view itself, and throw
+  // runtime_error("matrix not equal") when the shapes differ. The source
+  // may overlap the view in any way.
+  BasicMatrixView& operator=(const BasicMatrixView& other)
+    requires(!std::is_const_v<T>)
+  {
+    return Assign(expr::AsNode(other));
+  }
+  template <expr::Operand E>
+  BasicMatrixView& operator=(const E& other)
+    requires(!std::is_const_v<T>)
+  {
+    return Assign(expr::AsNode(other));
+  }
+  template <expr::Operand E>
+  BasicMatrixView& operator+=(const E& other)
+    requires(!std::is_const_v<T>)
+  {
+    return *this = *this + other;
+  }
+  template <expr::Operand E>
+  BasicMatrixView& operator-=(const E& other)
+    requires(!std::is_const_v<T>)
+  {
+    return *this = *this - other;
+  }
+  BasicMatrixView& operator*=(value_type num)
+    requires(!std::is_const_v<T>)
+  {
+    return *this = *this * num;
+  }
+
+  size_t getRows() const { return count_rows; }
+  size_t getColumns() const { return count_column; }
+  size_t stride() const { return stride_; }
+  size_t size() const { return count_rows * count_column; }
+  T* data() const { return data_; }
+
+  // Unchecked element access.
+  T& operator()(size_t i, size_t j) const { return data_[i * stride_ + j]; }
+
+  // Rows [begin, end), columns [begin, end), and the rows x column block
+  // whose top left element is (row, col). Throw out_of_range("out of rows")
+  // or out_of_range("out of columns") when the range does not fit.
+  BasicMatrixView rows(size_t begin, size_t end) const {
+    CheckRange(begin, end, count_rows, "out of rows");
+    return BasicMatrixView(data_ + begin * stride_, end - begin,
+                           count_column, stride_);
+  }
+  BasicMatrixView columns(size_t begin, size_t end) const {
+    CheckRange(begin, end, count_column, "out of columns");
+    return BasicMatrixView(data_ + begin, count_rows, end - begin, stride_);
+  }
+  BasicMatrixView block(size_t row, size_t col, size_t rows,
+                        size_t column) const {
+    return this->rows(row, row + rows).columns(col, col + column);
+  }
+
+  // Returns the getColumns() x getRows() transpose as a new matrix.
+  BasicMatrix<value_type> transpose() const {
+    using Result = BasicMatrix<value_type>;
+    Result res(count_column, count_rows, typename Result::Uninitialized());
+    transposeTo<value_type>(*this, res);
+    return res;
+  }
+
+  // Transposes a square view in place; throws runtime_error("matrix not
+  // square") otherwise.
+  void transposeInPlace() const
+    requires(!std::is_const_v<T>)
+  {
+    transposeSquare<value_type>(*this);
+  }
+
+private:
+  static void CheckRange(size_t begin, size_t end, size_t count,
+                         const char* what) {
+    if (begin > end || end > count) {
+      throw std::out_of_range(what);
+    }
+  }
+
+  template <expr::Node E>
+  BasicMatrixView& Assign(const E& node) {
+    if (node.getRows() != count_rows || node.getColumns() != count_column) {
+      throw std::runtime_error("matrix not equal");
+    }
+    // Storage the view spans, gaps between its rows included.
+    size_t extent =
+        count_rows == 0 ? 0 : (count_rows - 1) * stride_ + count_column;
+    if (node.conflicts(data_, data_ + extent, data_, stride_)) {
+      BasicMatrix<value_type> copy(node);
+      expr::Evaluate(expr::AsNode(copy), data_, stride_);
+    } else {
+      expr::Evaluate(node, data_, stride_);
+    }
+    return *this;
+  }
+
+  T* data_;
+  size_t count_rows, count_column, stride_;
+};
+
+template <class T>
+BasicMatrixView(BasicMatrix<T>&) -> BasicMatrixView<T>;
+
+template <class T>
+BasicMatrixView(const BasicMatrix<T>&) -> BasicMatrixView<const T>;
+
+using MatrixView = BasicMatrixView<int32_t>;
+using ConstMatrixView = BasicMatrixView<const int32_t>;
+
+template <class T>
+constexpr bool kIsView = false;
+
+template <class T>
+constexpr bool kIsView<BasicMatrixView<T>> = true;
+
+// ==, != and * between views, or a view and a matrix, of one element type;
+// two matrices use their own operators.
+template <class L, class R>
+concept ViewPair =
+    expr::Storage<L> && expr::Storage<R> && (kIsView<L> || kIsView<R>) &&
+    std::is_same_v<typename L::value_type, typename R::value_type>;
+
+template <class L, class R>
+  requires ViewPair<L, R>
+bool operator==(const L& m1, const R& m2) {
+  return equal<typename L::value_type>(m1, m2);
+}
+
+template <class L, class R>
+  requires ViewPair<L, R>
+bool operator!=(const L& m1, const R& m2) {
+  return !equal<typename L::value_type>(m1, m2);
+}
+
+// Throws runtime_error("matrix not multipliable") like the matrix product.
+template <class L, class R>
+  requires ViewPair<L, R>
+auto operator*(const L& m1, const R& m2) {
+  return multiply<typename L::value_type>(m1, m2);
+}
+
+template <class T>
+std::ostream& operator<<(std::ostream& os, const BasicMatrixView<T>& view) {
+  return print<std::remove_const_t<T>>(os, view);
+}
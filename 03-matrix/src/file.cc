@@ -0,0 +1,325 @@
+#include "file.hh"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+namespace {
+
+// Rows smaller than this are gathered before they reach the file.
+constexpr size_t kWriteBuffer = size_t(1) << 20;
+
+// A mapping starts on a page, so larger alignments could not be honoured.
+constexpr size_t kMaxAlignment = 4096;
+
+// MatrixFileHeader::kByteOrder as written by a host of the other byte order.
+constexpr uint32_t kSwappedByteOrder = 0x04030201;
+
+[[noreturn]] void ThrowErrno(const std::string& path) {
+  throw std::system_error(errno, std::generic_category(), path);
+}
+
+// Closes a descriptor on every way out of a scope.
+class FileDescriptor {
+public:
+  explicit FileDescriptor(int fd) : fd_(fd) {}
+  FileDescriptor(const FileDescriptor&) = delete;
+  FileDescriptor& operator=(const FileDescriptor&) = delete;
+  ~FileDescriptor() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  int get() const { return fd_; }
+
+private:
+  int fd_;
+};
+
+bool ValidAlignment(size_t alignment, size_t element) {
+  return std::has_single_bit(alignment) && alignment >= element &&
+         alignment <= kMaxAlignment;
+}
+
+// Checks everything the header claims against T and the file length
+// before any of it is trusted.
+template <class T>
+void CheckHeader(const MatrixFileHeader& header, size_t length) {
+  if (std::memcmp(header.magic, MatrixFileHeader::kMagic,
+                  sizeof(header.magic)) != 0) {
+    throw std::runtime_error("invalid matrix file");
+  }
+  // Checked before any other field, all of which would read swapped.
+  if (header.byte_order == kSwappedByteOrder) {
+    throw std::runtime_error("matrix byte order mismatch");
+  }
+  if (header.byte_order != MatrixFileHeader::kByteOrder ||
+      header.version != MatrixFileHeader::kVersion) {
+    throw std::runtime_error("invalid matrix file");
+  }
+  if (header.type != kElementType<T>) {
+    throw std::runtime_error("matrix type mismatch");
+  }
+  bool fits = header.columns == 0 ||
+              header.rows <= SIZE_MAX / sizeof(T) / header.columns;
+  if (header.element_size != sizeof(T) || !fits ||
+      !ValidAlignment(header.alignment, alignof(T)) ||
+      header.data_offset < sizeof(MatrixFileHeader) ||
+      header.data_offset % header.alignment != 0 ||
+      header.data_offset > length ||
+      length - header.data_offset !=
+          header.rows * header.columns * sizeof(T)) {
+    throw std::runtime_error("invalid matrix file");
+  }
+}
+
+}  // namespace
+
+void MatrixChecksum::update(const void* data, size_t bytes) {
+  const char* bytes_in = static_cast<const char*>(data);
+  if (partial_bytes_ > 0) {
+    size_t take = std::min(bytes, sizeof(uint64_t) - partial_bytes_);
+    std::memcpy(reinterpret_cast<char*>(&partial_) + partial_bytes_,
+                bytes_in, take);
+    partial_bytes_ += take;
+    bytes_in += take;
+    bytes -= take;
+    if (partial_bytes_ < sizeof(uint64_t)) {
+      return;
+    }
+    sum_ += partial_;
+    running_ += sum_;
+    partial_ = 0;
+    partial_bytes_ = 0;
+  }
+  uint64_t sum = sum_, running = running_;
+  size_t words = bytes / sizeof(uint64_t);
+  for (size_t i = 0; i < words; ++i) {
+    uint64_t word;
+    std::memcpy(&word, bytes_in + i * sizeof(uint64_t), sizeof(uint64_t));
+    sum += word;
+    running += sum;
+  }
+  sum_ = sum;
+  running_ = running;
+  partial_bytes_ = bytes % sizeof(uint64_t);
+  if (partial_bytes_ > 0) {
+    std::memcpy(&partial_, bytes_in + words * sizeof(uint64_t),
+                partial_bytes_);
+  }
+}
+
+uint64_t MatrixChecksum::value() const {
+  uint64_t sum = sum_, running = running_;
+  if (partial_bytes_ > 0) {
+    sum += partial_;
+    running += sum;
+  }
+  return std::rotl(running, 32) ^ sum;
+}
+
+template <class T>
+MatrixWriter<T>::MatrixWriter(const std::string& path, size_t rows,
+                              size_t column, size_t alignment)
+    : path_(path), count_rows(rows), count_column(column), header_() {
+  if (!ValidAlignment(alignment, alignof(T))) {
+    throw std::invalid_argument("invalid alignment");
+  }
+  std::memcpy(header_.magic, MatrixFileHeader::kMagic, sizeof(header_.magic));
+  header_.byte_order = MatrixFileHeader::kByteOrder;
+  header_.version = MatrixFileHeader::kVersion;
+  header_.type = kElementType<T>;
+  header_.element_size = sizeof(T);
+  header_.alignment = uint32_t(alignment);
+  header_.rows = rows;
+  header_.columns = column;
+  header_.data_offset =
+      (sizeof(MatrixFileHeader) + alignment - 1) / alignment * alignment;
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    ThrowErrno(path_);
+  }
+  // Zeros stand in for the header and its padding until finish().
+  buffer_.resize(kWriteBuffer);
+  buffered_ = header_.data_offset;
+}
+
+template <class T>
+MatrixWriter<T>::~MatrixWriter() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+template <class T>
+void MatrixWriter<T>::write(BasicMatrixView<const T> block) {
+  if (block.getColumns() != count_column) {
+    throw std::runtime_error("matrix not equal");
+  }
+  if (block.getRows() > count_rows - written_rows) {
+    throw std::out_of_range("out of rows");
+  }
+  size_t row_bytes = count_column * sizeof(T);
+  if (block.stride() == count_column) {
+    Put(block.data(), block.getRows() * row_bytes);
+  } else {
+    for (size_t i = 0; i < block.getRows(); ++i) {
+      Put(&block(i, 0), row_bytes);
+    }
+  }
+  written_rows += block.getRows();
+}
+
+template <class T>
+void MatrixWriter<T>::finish() {
+  if (fd_ < 0) {
+    return;
+  }
+  if (written_rows != count_rows) {
+    throw std::runtime_error("matrix file incomplete");
+  }
+  Flush();
+  header_.checksum = checksum_.value();
+  ssize_t written = ::pwrite(fd_, &header_, sizeof(header_), 0);
+  if (written != ssize_t(sizeof(header_))) {
+    throw std::system_error(written < 0 ? errno : EIO,
+                            std::generic_category(), path_);
+  }
+  int fd = std::exchange(fd_, -1);
+  if (::close(fd) != 0) {
+    ThrowErrno(path_);
+  }
+}
+
+template <class T>
+void MatrixWriter<T>::Put(const void* data, size_t bytes) {
+  if (bytes == 0) {
+    return;
+  }
+  checksum_.update(data, bytes);
+  if (bytes >= buffer_.size()) {
+    Flush();
+    WriteAll(data, bytes);
+    return;
+  }
+  if (buffered_ + bytes > buffer_.size()) {
+    Flush();
+  }
+  std::memcpy(buffer_.data() + buffered_, data, bytes);
+  buffered_ += bytes;
+}
+
+template <class T>
+void MatrixWriter<T>::Flush() {
+  WriteAll(buffer_.data(), buffered_);
+  buffered_ = 0;
+}
+
+template <class T>
+void MatrixWriter<T>::WriteAll(const void* data, size_t bytes) {
+  const char* from = static_cast<const char*>(data);
+  while (bytes > 0) {
+    ssize_t written = ::write(fd_, from, bytes);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      ThrowErrno(path_);
+    }
+    from += written;
+    bytes -= size_t(written);
+  }
+}
+
+template <class T>
+MappedMatrix<T>::MappedMatrix(const std::string& path, bool populate)
+    : header_() {
+  FileDescriptor fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+  struct stat status;
+  if (fd.get() < 0 || ::fstat(fd.get(), &status) != 0) {
+    ThrowErrno(path);
+  }
+  size_t length = size_t(status.st_size);
+  if (length < sizeof(MatrixFileHeader)) {
+    throw std::runtime_error("invalid matrix file");
+  }
+  ssize_t read = ::pread(fd.get(), &header_, sizeof(header_), 0);
+  if (read != ssize_t(sizeof(header_))) {
+    throw std::system_error(read < 0 ? errno : EIO, std::generic_category(),
+                            path);
+  }
+  CheckHeader<T>(header_, length);
+  int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+  if (populate) {
+    flags |= MAP_POPULATE;
+  }
+#else
+  (void)populate;
+#endif
+  void* mapping = ::mmap(nullptr, length, PROT_READ, flags, fd.get(), 0);
+  if (mapping == MAP_FAILED) {
+    ThrowErrno(path);
+  }
+  mapping_ = mapping;
+  length_ = length;
+}
+
+template <class T>
+MappedMatrix<T>::MappedMatrix(MappedMatrix&& other) noexcept
+    : mapping_(std::exchange(other.mapping_, nullptr)),
+      length_(std::exchange(other.length_, 0)),
+      header_(std::exchange(other.header_, MatrixFileHeader())) {}
+
+template <class T>
+MappedMatrix<T>& MappedMatrix<T>::operator=(MappedMatrix&& other) noexcept {
+  if (this != &other) {
+    if (mapping_ != nullptr) {
+      ::munmap(mapping_, length_);
+    }
+    mapping_ = std::exchange(other.mapping_, nullptr);
+    length_ = std::exchange(other.length_, 0);
+    header_ = std::exchange(other.header_, MatrixFileHeader());
+  }
+  return *this;
+}
+
+template <class T>
+MappedMatrix<T>::~MappedMatrix() {
+  if (mapping_ != nullptr) {
+    ::munmap(mapping_, length_);
+  }
+}
+
+template <class T>
+bool MappedMatrix<T>::verify() const {
+  MatrixChecksum checksum;
+  if (mapping_ != nullptr) {
+    checksum.update(static_cast<const char*>(mapping_) + header_.data_offset,
+                    length_ - header_.data_offset);
+  }
+  return checksum.value() == header_.checksum;
+}
+
+template class MatrixWriter<int8_t>;
+template class MatrixWriter<int32_t>;
+template class MatrixWriter<int64_t>;
+template class MatrixWriter<float>;
+template class MatrixWriter<double>;
+
+template class MappedMatrix<int8_t>;
+template class MappedMatrix<int32_t>;
+template class MappedMatrix<int64_t>;
+template class MappedMatrix<float>;
+template class MappedMatrix<double>;
@@ -1,6 +1,50 @@
 #include <gtest/gtest.h>
+#include <unistd.h>
 
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <new>
+#include <sstream>
+#include <system_error>
+
+#include "file.hh"
 #include "matrix.hh"
+#include "parallel.hh"
+#include "sparse.hh"
+
+namespace {
+
+std::atomic<size_t> allocations = 0;
+
+template <class Function>
+size_t AllocationsDuring(Function function) {
+  size_t before = allocations;
+  function();
+  return allocations - before;
+}
+
+}  // namespace
+
+// Counts every heap allocation so tests can prove a path allocates nothing.
+void* operator new(size_t size) {
+  ++allocations;
+  if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+    return memory;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+  std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+  std::free(memory);
+}
 
 class SquareMatrix : public ::testing::Test {
  protected:
@@ -119,6 +163,728 @@ TEST_F(RectangularMatrix, test_sum_exception) {
   }
 }
 
+TEST_F(RectangularMatrix, test_flat_storage) {
+  ASSERT_EQ(M(2, 1), 6);
+  M(1, 0) = 7;
+  ASSERT_EQ(M[1][0], 7);
+  const int32_t expected[] = {1, 2, 7, 4, 5, 6};
+  for (size_t i = 0; i < M.size(); ++i) {
+    ASSERT_EQ(M.data()[i], expected[i]);
+  }
+}
+
+TEST_F(RectangularMatrix, test_compare_shapes) {
+  ASSERT_FALSE(Matrix(2, 3) == Matrix(3, 2));
+  ASSERT_TRUE(Matrix(40, 3, 5) == Matrix(40, 3, 5));
+  Matrix large(40, 3, 5);
+  large(39, 2) = 0;
+  ASSERT_TRUE(large != Matrix(40, 3, 5));
+}
+
+TEST_F(RectangularMatrix, test_product) {
+  ASSERT_TRUE(M * D == Matrix({{9, 12, 15}, {19, 26, 33}, {29, 40, 51}}));
+  ASSERT_TRUE(D * M == Matrix({{22, 28}, {49, 64}}));
+  try {
+    M * M;
+    FAIL();
+  } catch (std::exception& e) {
+    ASSERT_STREQ(e.what(), "matrix not multipliable");
+  }
+}
+
+TEST(MatrixProduct, test_blocked_edges) {
+  // Odd sizes cross every cache block and leave partial register tiles.
+  const size_t m = 131, k = 300, n = 2071;
+  Matrix a(m, k), b(k, n);
+  for (size_t i = 0; i < a.size(); ++i) {
+    a.data()[i] = int32_t(i % 23) - 11;
+  }
+  for (size_t i = 0; i < b.size(); ++i) {
+    b.data()[i] = int32_t(i % 17) - 8;
+  }
+  Matrix expected(m, n);
+  for (size_t i = 0; i < m; ++i) {
+    for (size_t p = 0; p < k; ++p) {
+      for (size_t j = 0; j < n; ++j) {
+        expected(i, j) += a(i, p) * b(p, j);
+      }
+    }
+  }
+  ASSERT_TRUE(a * b == expected);
+  ASSERT_TRUE(multiplyChecked(a, b) == expected);
+}
+
+TEST(MatrixProduct, test_checked_overflow) {
+  Matrix big(2, 2, 1 << 16);
+  try {
+    multiplyChecked(big, big);
+    FAIL();
+  } catch (std::overflow_error& e) {
+    ASSERT_STREQ(e.what(), "matrix overflow");
+  }
+  Matrix small(2, 2, 1 << 14);
+  ASSERT_TRUE(multiplyChecked(small, small) == Matrix(2, 2, 1 << 29));
+}
+
+TEST(MatrixProduct, test_checked_extremes) {
+  // Two products of INT32_MIN already sum past INT64_MAX.
+  const int32_t min = std::numeric_limits<int32_t>::min();
+  const int32_t max = std::numeric_limits<int32_t>::max();
+  ASSERT_THROW(multiplyChecked(Matrix(1, 4, min), Matrix(4, 1, min)),
+               std::overflow_error);
+  ASSERT_THROW(multiplyChecked(Matrix(1, 2, max), Matrix(2, 1, max)),
+               std::overflow_error);
+  // Partial sums reach 2^63 before the last terms cancel them.
+  Matrix row(1, 5, min);
+  Matrix column({{min}, {min}, {max}, {max}, {2}});
+  ASSERT_TRUE(multiplyChecked(row, column) == Matrix(1, 1, 0));
+}
+
+TEST_F(SquareMatrix, test_fused_expression) {
+  Matrix C(3, 3, 1);
+  Matrix R = M + D * 3 + C;
+  ASSERT_TRUE(R == Matrix({{29, 27, 25}, {23, 21, 19}, {17, 15, 13}}));
+  ASSERT_TRUE(2 * M - D == Matrix({{-7, -4, -1}, {2, 5, 8}, {11, 14, 17}}));
+  const int32_t* storage = R.data();
+  R = R - M;
+  ASSERT_EQ(R.data(), storage);
+  ASSERT_TRUE(R == D * 3 + C);
+  R = Matrix(2, 2) + Matrix(2, 2, 4);
+  ASSERT_TRUE(R == Matrix(2, 2, 4));
+}
+
+TEST_F(SquareMatrix, test_print_expression) {
+  std::ostringstream sum, expected;
+  sum << M + D << 2 * M;
+  expected << Matrix(M + D) << Matrix(2 * M);
+  ASSERT_EQ(sum.str(), expected.str());
+  ASSERT_EQ(sum.str().substr(0, 9), "10 10 10 ");
+}
+
+TEST_F(SquareMatrix, test_index_expression) {
+  ASSERT_EQ((M + D)[1][2], 10);
+  ASSERT_EQ((M - D * 2)[2][0], 1);
+  ASSERT_EQ((3 * M.rows(1, 3))[0][1], 15);
+  ASSERT_THROW((M + D)[3][0], std::out_of_range);
+  try {
+    (M + D)[0][3];
+    FAIL();
+  } catch (std::out_of_range& e) {
+    ASSERT_STREQ(e.what(), "out of columns");
+  }
+}
+
+TEST_F(SquareMatrix, test_compare_and_multiply_expressions) {
+  Matrix sum = M + D, difference = M - D;
+  ASSERT_TRUE((M + D) * (M - D) == sum * difference);
+  ASSERT_TRUE((M + D) * M == sum * M);
+  ASSERT_TRUE(M * (M - D) == M * difference);
+  ASSERT_TRUE((M + D) == sum);
+  ASSERT_TRUE(sum == M + D);
+  ASSERT_TRUE((M + D) == (D + M));
+  ASSERT_TRUE((M + D) != (M - D));
+  ASSERT_TRUE(M != M + D);
+  ASSERT_FALSE((M + D) != sum);
+  ASSERT_TRUE(M.view() * (2 * D) == M * (D + D));
+  ASSERT_THROW((M + D) * M.rows(0, 2), std::runtime_error);
+}
+
+TEST_F(RectangularMatrix, test_expression_shapes) {
+  Matrix C(3, 2);
+  try {
+    M + C * 2 + D;
+    FAIL();
+  } catch (std::exception& e) {
+    ASSERT_STREQ(e.what(), "matrix not equal");
+  }
+}
+
+TEST_F(SquareMatrix, test_move) {
+  const int32_t* storage = M.data();
+  Matrix moved(0, 0);
+  ASSERT_EQ(AllocationsDuring([&] { moved = std::move(M); }), 0);
+  ASSERT_EQ(moved.data(), storage);
+  ASSERT_EQ(M.getRows(), 0);
+  ASSERT_EQ(M.getColumns(), 0);
+  ASSERT_EQ(AllocationsDuring([&] { Matrix again(std::move(moved)); }), 0);
+  ASSERT_EQ(moved.size(), 0);
+  M = D;
+  ASSERT_TRUE(M == D);
+}
+
+TEST_F(SquareMatrix, test_assignment_reuses_storage) {
+  const int32_t* storage = M.data();
+  ASSERT_EQ(AllocationsDuring([&] { M = D; }), 0);
+  ASSERT_EQ(M.data(), storage);
+  ASSERT_TRUE(M == D);
+  M = M;
+  ASSERT_TRUE(M == D);
+  ASSERT_EQ(AllocationsDuring([&] { M = Matrix(3, 4); }), 1);
+  ASSERT_EQ(M.getColumns(), 4);
+}
+
+TEST_F(SquareMatrix, test_compound_assignment) {
+  Matrix C(3, 3, 1);
+  size_t count = AllocationsDuring([&] {
+    C += M;
+    C -= D;
+    C += M * 2 - D;
+  });
+  ASSERT_EQ(count, 0);
+  ASSERT_TRUE(C == Matrix({{-14, -9, -4}, {1, 6, 11}, {16, 21, 26}}));
+  try {
+    C += Matrix(2, 3);
+    FAIL();
+  } catch (std::exception& e) {
+    ASSERT_STREQ(e.what(), "matrix not equal");
+  }
+}
+
+TEST_F(SquareMatrix, test_views) {
+  ASSERT_TRUE(M.rows(1, 3) == Matrix({{4, 5, 6}, {7, 8, 9}}));
+  ASSERT_TRUE(M.columns(1, 2).transpose() == Matrix({{2, 5, 8}}));
+  ConstMatrixView block = M.block(1, 1, 2, 2);
+  ASSERT_EQ(block.stride(), 3);
+  ASSERT_TRUE(block == Matrix({{5, 6}, {8, 9}}));
+  ASSERT_TRUE(block.rows(1, 2).columns(0, 1) == Matrix(1, 1, 8));
+  ASSERT_TRUE(M.view() == M);
+  ASSERT_TRUE(M.rows(0, 2) != M.rows(1, 3));
+  std::stringstream out;
+  out << block;
+  ASSERT_EQ(out.str(), "5 6 \n8 9 \n");
+  try {
+    M.rows(2, 4);
+    FAIL();
+  } catch (std::out_of_range& e) {
+    ASSERT_STREQ(e.what(), "out of rows");
+  }
+  try {
+    M.block(1, 2, 1, 2);
+    FAIL();
+  } catch (std::out_of_range& e) {
+    ASSERT_STREQ(e.what(), "out of columns");
+  }
+}
+
+TEST_F(SquareMatrix, test_write_through_views) {
+  MatrixView block = M.block(0, 1, 2, 2);
+  block = D.block(1, 0, 2, 2);
+  ASSERT_TRUE(M == Matrix({{1, 6, 5}, {4, 3, 2}, {7, 8, 9}}));
+  block += Matrix(2, 2, 1);
+  block *= 2;
+  ASSERT_TRUE(M == Matrix({{1, 14, 12}, {4, 8, 6}, {7, 8, 9}}));
+  M.columns(0, 1) = M.columns(2, 3) - D.columns(0, 1) * 2;
+  ASSERT_TRUE(M == Matrix({{-6, 14, 12}, {-6, 8, 6}, {3, 8, 9}}));
+  Matrix sum = M.rows(0, 1) + D.rows(2, 3);
+  ASSERT_TRUE(sum == Matrix({{-3, 16, 13}}));
+  try {
+    block = M.rows(0, 1);
+    FAIL();
+  } catch (std::runtime_error& e) {
+    ASSERT_STREQ(e.what(), "matrix not equal");
+  }
+}
+
+TEST_F(SquareMatrix, test_overlapping_assignment) {
+  // Sources that overlap the destination at other positions are read
+  // before anything is written.
+  M.rows(0, 2) = M.rows(1, 3);
+  ASSERT_TRUE(M == Matrix({{4, 5, 6}, {7, 8, 9}, {7, 8, 9}}));
+  M.columns(1, 3) = M.columns(0, 2) + M.columns(1, 3);
+  ASSERT_TRUE(M == Matrix({{4, 9, 11}, {7, 15, 17}, {7, 15, 17}}));
+  M = M.block(1, 1, 2, 2) * 2;
+  ASSERT_TRUE(M == Matrix({{30, 34}, {30, 34}}));
+  D = D.rows(0, 2) + D.rows(1, 3);
+  ASSERT_TRUE(D == Matrix({{15, 13, 11}, {9, 7, 5}}));
+}
+
+TEST(MatrixView, test_product_of_blocks) {
+  Matrix a(50, 70), b(80, 60);
+  for (size_t i = 0; i < a.size(); ++i) {
+    a.data()[i] = int32_t(i % 13) - 6;
+  }
+  for (size_t i = 0; i < b.size(); ++i) {
+    b.data()[i] = int32_t(i % 9) - 4;
+  }
+  ConstMatrixView left = a.block(3, 5, 20, 33), right = b.block(7, 2, 33, 41);
+  Matrix expected = Matrix(left) * Matrix(right);
+  ASSERT_TRUE(left * right == expected);
+  ASSERT_TRUE(Matrix(left) * right == expected);
+  ASSERT_THROW(left * left, std::runtime_error);
+}
+
+TEST(MatrixTranspose, test_out_of_place) {
+  for (auto [rows, columns] : std::vector<std::pair<size_t, size_t>>{
+           {1, 1}, {1, 100}, {100, 1}, {37, 53}, {64, 64}, {130, 17}}) {
+    Matrix m(rows, columns);
+    for (size_t i = 0; i < m.size(); ++i) {
+      m.data()[i] = int32_t(i);
+    }
+    Matrix t = m.transpose();
+    ASSERT_EQ(t.getRows(), columns);
+    for (size_t i = 0; i < rows; ++i) {
+      for (size_t j = 0; j < columns; ++j) {
+        ASSERT_EQ(t(j, i), m(i, j));
+      }
+    }
+    ASSERT_TRUE(m.columns(0, columns / 2).transpose() ==
+                t.rows(0, columns / 2));
+  }
+}
+
+TEST(MatrixTranspose, test_in_place) {
+  for (size_t n : {1, 15, 16, 17, 33, 100}) {
+    Matrix m(n, n);
+    for (size_t i = 0; i < m.size(); ++i) {
+      m.data()[i] = int32_t(i);
+    }
+    Matrix expected = m.transpose();
+    const int32_t* storage = m.data();
+    m.transposeInPlace();
+    ASSERT_EQ(m.data(), storage);
+    ASSERT_TRUE(m == expected);
+  }
+  // A square block of a larger matrix; the rest stays put.
+  Matrix m(40, 50);
+  for (size_t i = 0; i < m.size(); ++i) {
+    m.data()[i] = int32_t(i);
+  }
+  Matrix expected = m;
+  expected.block(2, 5, 35, 35) = m.block(2, 5, 35, 35).transpose();
+  m.block(2, 5, 35, 35).transposeInPlace();
+  ASSERT_TRUE(m == expected);
+  try {
+    m.rows(0, 3).transposeInPlace();
+    FAIL();
+  } catch (std::runtime_error& e) {
+    ASSERT_STREQ(e.what(), "matrix not square");
+  }
+  expected = m.transpose();
+  m.transposeInPlace();
+  ASSERT_TRUE(m == expected);
+}
+
+TEST(MatrixAllocations, test_hot_loop) {
+  parallel::setThreads(2);
+  size_t threshold = parallel::threshold();
+  parallel::setThreshold(0);
+  Matrix a(64, 64, 1), b(64, 64, 2), c(64, 64);
+  // The first parallel call starts the pool; count only the steady state.
+  c = a + b;
+  size_t count = AllocationsDuring([&] {
+    for (int i = 0; i < 100; ++i) {
+      c = a + b * 3;
+      c += a;
+      c -= b;
+      c *= 2;
+      c = a;
+      ASSERT_TRUE(c != b);
+    }
+  });
+  parallel::setThreads(0);
+  parallel::setThreshold(threshold);
+  ASSERT_EQ(count, 0);
+}
+
+class SparseMatrix : public ::testing::Test {
+ protected:
+  void SetUp() {
+    // Row 1 and column 2 are empty; row 3 holds most of the nonzeros.
+    M = Matrix({{0, 3, 0, 0, -1},
+                {0, 0, 0, 0, 0},
+                {4, 0, 0, 0, 0},
+                {2, 5, 0, 7, 1}});
+    D = Matrix({{1, 2, 3, 4, 5},
+                {6, 7, 8, 9, 10},
+                {11, 12, 13, 14, 15},
+                {16, 17, 18, 19, 20}});
+  }
+
+  Matrix M, D;
+};
+
+TEST_F(SparseMatrix, test_conversions) {
+  CsrMatrix csr(M);
+  ASSERT_EQ(csr.nonZeros(), 7);
+  ASSERT_EQ(csr.offsets(), std::vector<size_t>({0, 2, 2, 3, 7}));
+  ASSERT_EQ(csr.indices(), std::vector<uint32_t>({1, 4, 0, 0, 1, 3, 4}));
+  ASSERT_TRUE(csr.toDense() == M);
+  CscMatrix csc(M);
+  ASSERT_EQ(csc.offsets(), std::vector<size_t>({0, 2, 4, 4, 5, 7}));
+  ASSERT_EQ(csc.indices(), std::vector<uint32_t>({2, 3, 0, 3, 3, 0, 3}));
+  ASSERT_TRUE(csc.toDense() == M);
+  ASSERT_EQ(CscMatrix(csr).indices(), csc.indices());
+  ASSERT_EQ(CsrMatrix(csc).values(), csr.values());
+  ASSERT_TRUE(CsrMatrix(3, 2).toDense() == Matrix(3, 2));
+}
+
+TEST_F(SparseMatrix, test_raw_arrays) {
+  // Repeated indices add up.
+  CsrMatrix csr(2, 3, {0, 2, 3}, {2, 2, 0}, {1, 4, 7});
+  ASSERT_TRUE(csr.toDense() == Matrix({{0, 0, 5}, {7, 0, 0}}));
+  ASSERT_THROW(CsrMatrix(2, 3, {0, 2}, {0, 1}, {1, 1}),
+               std::invalid_argument);
+  ASSERT_THROW(CsrMatrix(2, 3, {0, 1, 1}, {3}, {1}), std::invalid_argument);
+  try {
+    CscMatrix(2, 3, {0, 2, 1, 2}, {0, 1}, {1, 1});
+    FAIL();
+  } catch (std::invalid_argument& e) {
+    ASSERT_STREQ(e.what(), "invalid sparse structure");
+  }
+}
+
+TEST_F(SparseMatrix, test_sum) {
+  Matrix expected = M + D;
+  ASSERT_TRUE(CsrMatrix(M) + D == expected);
+  ASSERT_TRUE(D + CscMatrix(M) == expected);
+  Matrix sum = D;
+  sum += CsrMatrix(M);
+  ASSERT_TRUE(sum == expected);
+  try {
+    D + CsrMatrix(5, 4);
+    FAIL();
+  } catch (std::runtime_error& e) {
+    ASSERT_STREQ(e.what(), "matrix not equal");
+  }
+}
+
+TEST_F(SparseMatrix, test_products) {
+  std::vector<int32_t> x = {1, -2, 3, 4, 5};
+  std::vector<int32_t> expected = {-11, 0, 4, 25};
+  ASSERT_EQ(CsrMatrix(M) * x, expected);
+  ASSERT_EQ(CscMatrix(M) * x, expected);
+  Matrix t = D.transpose();
+  ASSERT_TRUE(CsrMatrix(M) * t == M * t);
+  ASSERT_TRUE(t * CscMatrix(M) == t * M);
+  try {
+    CsrMatrix(M) * D;
+    FAIL();
+  } catch (std::runtime_error& e) {
+    ASSERT_STREQ(e.what(), "matrix not multipliable");
+  }
+  ASSERT_THROW(CscMatrix(M) * std::vector<int32_t>(4), std::runtime_error);
+}
+
+TEST(SparseProduct, test_wide_and_typed) {
+  // 70 columns cover full accumulator tiles and the scalar tail.
+  BasicMatrix<int8_t> a(9, 40), b(40, 70);
+  for (size_t i = 0; i < a.size(); i += 3) {
+    a.data()[i] = int8_t(i % 13) - 6;
+  }
+  for (size_t i = 0; i < b.size(); ++i) {
+    b.data()[i] = int8_t(i % 11) * 12;
+  }
+  BasicMatrix<int32_t> expected = a * b;
+  ASSERT_TRUE(BasicCsrMatrix<int8_t>(a) * b == expected);
+  ASSERT_TRUE(a * BasicCscMatrix<int8_t>(b) == expected);
+  BasicMatrix<double> d(4, 4, 0.5);
+  d(1, 1) = 0;
+  ASSERT_EQ(BasicCsrMatrix<double>(d).nonZeros(), 15);
+  ASSERT_EQ(BasicCsrMatrix<double>(d) * std::vector<double>(4, 2.0),
+            std::vector<double>({4.0, 3.0, 4.0, 4.0}));
+}
+
+class ParallelMatrix : public ::testing::Test {
+ protected:
+  void SetUp() {
+    threshold = parallel::threshold();
+    parallel::setThreads(4);
+    parallel::setThreshold(0);
+    A = Matrix(97, 203);
+    B = Matrix(97, 203);
+    for (size_t i = 0; i < A.size(); ++i) {
+      A.data()[i] = int32_t(i % 31) - 15;
+      B.data()[i] = int32_t(i % 7);
+    }
+  }
+  void TearDown() {
+    parallel::setThreads(0);
+    parallel::setThreshold(threshold);
+  }
+
+  size_t threshold;
+  Matrix A, B;
+};
+
+TEST_F(ParallelMatrix, test_elementwise) {
+  Matrix sum = A + B;
+  Matrix scaled = A;
+  scaled *= 3;
+  for (size_t i = 0; i < A.size(); ++i) {
+    ASSERT_EQ(sum.data()[i], A.data()[i] + B.data()[i]);
+    ASSERT_EQ(scaled.data()[i], A.data()[i] * 3);
+  }
+  Matrix copy = A;
+  ASSERT_TRUE(copy == A);
+  copy(96, 202) += 1;
+  ASSERT_TRUE(copy != A);
+}
+
+TEST_F(ParallelMatrix, test_transpose_and_product) {
+  Matrix t = A.transpose();
+  ASSERT_EQ(t.getRows(), 203);
+  ASSERT_EQ(t.getColumns(), 97);
+  for (size_t i = 0; i < A.getRows(); ++i) {
+    for (size_t j = 0; j < A.getColumns(); ++j) {
+      ASSERT_EQ(t(j, i), A(i, j));
+    }
+  }
+  Matrix product = A * t;
+  parallel::setThreads(1);
+  ASSERT_TRUE(product == A * t);
+}
+
+template <class T>
+class TypedMatrix : public ::testing::Test {};
+
+using ElementTypes = ::testing::Types<int8_t, int32_t, int64_t, float, double>;
+TYPED_TEST_SUITE(TypedMatrix, ElementTypes);
+
+TYPED_TEST(TypedMatrix, test_elementwise) {
+  using M = BasicMatrix<TypeParam>;
+  M a(3, 70, 2), b(3, 70, 5);
+  a(2, 69) = 7;
+  M r = a + b * TypeParam(3) - b;
+  ASSERT_EQ(r(0, 0), TypeParam(12));
+  ASSERT_EQ(r(2, 69), TypeParam(17));
+  r *= TypeParam(2);
+  ASSERT_EQ(r(1, 5), TypeParam(24));
+  ASSERT_TRUE(r == M(r));
+  ASSERT_TRUE(r != a);
+  ASSERT_THROW(M(a + M(70, 3)), std::runtime_error);
+}
+
+TYPED_TEST(TypedMatrix, test_product) {
+  using M = BasicMatrix<TypeParam>;
+  using P = ProductOf<TypeParam>;
+  // Small integer values stay exact in every type, including the float
+  // accumulators, and the odd sizes leave partial register tiles.
+  const size_t m = 13, k = 301, n = 37;
+  M a(m, k), b(k, n);
+  for (size_t i = 0; i < a.size(); ++i) {
+    a.data()[i] = TypeParam(int(i % 11) - 5);
+  }
+  for (size_t i = 0; i < b.size(); ++i) {
+    b.data()[i] = TypeParam(int(i % 7) - 3);
+  }
+  BasicMatrix<P> expected(m, n);
+  for (size_t i = 0; i < m; ++i) {
+    for (size_t p = 0; p < k; ++p) {
+      for (size_t j = 0; j < n; ++j) {
+        expected(i, j) += P(a(i, p)) * P(b(p, j));
+      }
+    }
+  }
+  BasicMatrix<P> product = a * b;
+  ASSERT_TRUE(product == expected);
+  ASSERT_THROW(a * a, std::runtime_error);
+}
+
+TEST(TypedMatrix, test_int8_product_widens) {
+  // 127 * 127 * 64 overflows int8 and int16 but fits the int32 result.
+  BasicMatrix<int8_t> a(2, 64, 127), b(64, 3, -127);
+  BasicMatrix<int32_t> product = a * b;
+  ASSERT_TRUE(product == Matrix(2, 3, -127 * 127 * 64));
+  std::stringstream out;
+  out << BasicMatrix<int8_t>(1, 2, -3);
+  ASSERT_EQ(out.str(), "-3 -3 \n");
+}
+
+TEST_F(ParallelMatrix, test_sparse) {
+  // Rows of very different lengths, so pieces of equal nonzero counts
+  // split inside the long ones.
+  Matrix sparse(A.getRows(), A.getColumns());
+  for (size_t i = 0; i < sparse.getRows(); ++i) {
+    for (size_t j = 0; j < sparse.getColumns(); j += 1 + i % 9) {
+      sparse(i, j) = A(i, j);
+    }
+  }
+  CsrMatrix csr(sparse);
+  std::vector<int32_t> x(A.getColumns());
+  for (size_t j = 0; j < x.size(); ++j) {
+    x[j] = int32_t(j % 5) - 2;
+  }
+  std::vector<int32_t> y = csr * x;
+  Matrix product = sparse * Matrix({x}).transpose();
+  for (size_t i = 0; i < y.size(); ++i) {
+    ASSERT_EQ(y[i], product(i, 0));
+  }
+  Matrix t = B.transpose();
+  ASSERT_TRUE(csr * t == sparse * t);
+  ASSERT_TRUE(B * CscMatrix(t) == B * t);
+}
+
+TEST_F(ParallelMatrix, test_views_and_transpose) {
+  MatrixView square = A.block(0, 100, 97, 97);
+  Matrix expected = square.transpose();
+  square.transposeInPlace();
+  ASSERT_TRUE(square == expected);
+  // Shifts A one column right while adding B, reading what it overwrites.
+  Matrix before = A;
+  A.columns(1, 203) = A.columns(0, 202) + B.columns(1, 203);
+  for (size_t i = 0; i < A.getRows(); ++i) {
+    ASSERT_EQ(A(i, 0), before(i, 0));
+    for (size_t j = 1; j < A.getColumns(); ++j) {
+      ASSERT_EQ(A(i, j), before(i, j - 1) + B(i, j));
+    }
+  }
+  Matrix difference = A.columns(1, 203) - B.columns(1, 203);
+  ASSERT_TRUE(difference == before.columns(0, 202));
+}
+
+class MatrixFile : public ::testing::Test {
+ protected:
+  void SetUp() {
+    path = (std::filesystem::temp_directory_path() /
+            ("matrix_test_" + std::to_string(::getpid()) + ".bin"))
+               .string();
+    M = Matrix(37, 23);
+    for (size_t i = 0; i < M.size(); ++i) {
+      M.data()[i] = int32_t(i * 2654435761u);
+    }
+  }
+
+  void TearDown() { std::filesystem::remove(path); }
+
+  std::string path;
+  Matrix M;
+};
+
+TEST_F(MatrixFile, test_round_trip) {
+  saveMatrix(path, M);
+  MappedMatrix<int32_t> mapped(path);
+  ASSERT_EQ(mapped.getRows(), 37);
+  ASSERT_EQ(mapped.getColumns(), 23);
+  ASSERT_EQ(mapped.header().data_offset, kMatrixFileAlignment);
+  ASSERT_EQ(uintptr_t(mapped.view().data()) % kMatrixFileAlignment, 0);
+  ASSERT_TRUE(mapped.view() == M);
+  ASSERT_TRUE(mapped.verify());
+  ASSERT_TRUE(loadMatrix<int32_t>(path) == M);
+  ASSERT_EQ(std::filesystem::file_size(path), 64 + M.size() * 4);
+
+  MappedMatrix<int32_t> moved = std::move(mapped);
+  ASSERT_TRUE(moved.view().rows(3, 5) == M.rows(3, 5));
+  ASSERT_EQ(mapped.getRows(), 0);
+
+  BasicMatrix<double> d(3, 5, 0.25);
+  saveMatrix(path, d.columns(1, 4));
+  ASSERT_TRUE(loadMatrix<double>(path) == BasicMatrix<double>(3, 3, 0.25));
+}
+
+TEST_F(MatrixFile, test_streaming_write) {
+  {
+    // Strided blocks of uneven heights, page-aligned elements.
+    MatrixWriter<int32_t> writer(path, 37, 20, 4096);
+    writer.write(M.block(0, 2, 10, 20));
+    writer.write(M.block(10, 2, 0, 20));
+    writer.write(M.block(10, 2, 27, 20));
+    try {
+      writer.write(M.block(0, 0, 1, 20));
+      FAIL();
+    } catch (std::out_of_range& e) {
+      ASSERT_STREQ(e.what(), "out of rows");
+    }
+    ASSERT_THROW(writer.write(M.rows(0, 0)), std::runtime_error);
+    writer.finish();
+  }
+  MappedMatrix<int32_t> mapped(path);
+  ASSERT_EQ(mapped.header().data_offset, 4096);
+  ASSERT_TRUE(mapped.view() == M.columns(2, 22));
+  ASSERT_TRUE(mapped.verify());
+
+  ASSERT_THROW(MatrixWriter<int64_t>(path, 1, 1, 4), std::invalid_argument);
+  ASSERT_THROW(MatrixWriter<int8_t>(path, 1, 1, 48), std::invalid_argument);
+}
+
+TEST_F(MatrixFile, test_checksum_pieces) {
+  std::vector<char> bytes(1000);
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    bytes[i] = char(i * 7);
+  }
+  MatrixChecksum whole, pieces;
+  whole.update(bytes.data(), bytes.size());
+  for (size_t begin = 0, step = 1; begin < bytes.size(); begin += step++) {
+    pieces.update(bytes.data() + begin,
+                  std::min(step, bytes.size() - begin));
+  }
+  ASSERT_EQ(whole.value(), pieces.value());
+  // Swapping two words changes the checksum.
+  std::swap_ranges(bytes.begin(), bytes.begin() + 8, bytes.begin() + 8);
+  MatrixChecksum swapped;
+  swapped.update(bytes.data(), bytes.size());
+  ASSERT_NE(swapped.value(), whole.value());
+}
+
+TEST_F(MatrixFile, test_invalid_files) {
+  ASSERT_THROW(MappedMatrix<int32_t>{path}, std::system_error);
+  {
+    // An unfinished writer leaves no header behind.
+    MatrixWriter<int32_t> writer(path, 37, 23);
+    writer.write(M.rows(0, 30));
+    ASSERT_THROW(writer.finish(), std::runtime_error);
+  }
+  try {
+    MappedMatrix<int32_t> mapped(path);
+    FAIL();
+  } catch (std::runtime_error& e) {
+    ASSERT_STREQ(e.what(), "invalid matrix file");
+  }
+
+  saveMatrix(path, M);
+  try {
+    MappedMatrix<float> mapped(path);
+    FAIL();
+  } catch (std::runtime_error& e) {
+    ASSERT_STREQ(e.what(), "matrix type mismatch");
+  }
+  {
+    // Flip one bit of the last element.
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(-1, std::ios::end);
+    file.put(char(M(36, 22) >> 24 ^ 1));
+  }
+  ASSERT_FALSE(MappedMatrix<int32_t>(path).verify());
+  std::filesystem::resize_file(path, 64 + M.size() * 4 - 4);
+  ASSERT_THROW(MappedMatrix<int32_t>{path}, std::runtime_error);
+
+  // The marker as a host of the other byte order writes it.
+  saveMatrix(path, M);
+  {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(offsetof(MatrixFileHeader, byte_order));
+    uint32_t swapped = 0x04030201;
+    file.write(reinterpret_cast<const char*>(&swapped), sizeof(swapped));
+  }
+  try {
+    MappedMatrix<int32_t> mapped(path);
+    FAIL();
+  } catch (std::runtime_error& e) {
+    ASSERT_STREQ(e.what(), "matrix byte order mismatch");
+  }
+}
+
+TEST(ThreadPool, test_run_and_errors) {
+  parallel::ThreadPool pool(3);
+  std::vector<int> hits(100);
+  pool.run(hits.size(), [&](size_t i) {
+    // Nested runs execute inline on the calling worker.
+    pool.run(2, [&](size_t) { ++hits[i]; });
+  });
+  ASSERT_EQ(std::count(hits.begin(), hits.end(), 2), 100);
+  try {
+    pool.run(10, [](size_t i) {
+      if (i == 7) {
+        throw std::runtime_error("task failed");
+      }
+    });
+    FAIL();
+  } catch (std::runtime_error& e) {
+    ASSERT_STREQ(e.what(), "task failed");
+  }
+  pool.run(1, [&](size_t) { hits[0] = 0; });
+  ASSERT_EQ(hits[0], 0);
+}
+
 int main(int argc, char* argv[]) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
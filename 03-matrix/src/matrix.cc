@@ -1,161 +1,363 @@
 #include "matrix.hh"
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <stdexcept>
+#include <utility>
 
-int32_t& Matrix::ProxyRow::operator[](size_t j) {
-  if (j >= count_column) {
-    throw std::out_of_range("out of columns");
-  }
-  return data_[j];
-} 
+#include "parallel.hh"
 
-Matrix::ProxyRow& Matrix::operator[](size_t i) const{
-  if (i >= count_rows) {
-    throw std::out_of_range("out of rows");
+namespace {
+
+using expr::kTile;
+
+// Transposes recurse until both sides of a block are at most this long;
+// such a block's rows, read and written, stay in L1.
+constexpr size_t kTransposeLeaf = 16;
+
+template <class T>
+void ScaleKernel(T* __restrict data, T num, size_t n) {
+  size_t i = 0;
+  for (; i + kTile<T> <= n; i += kTile<T>) {
+    for (size_t k = 0; k < kTile<T>; ++k) {
+      data[i + k] = T(data[i + k] * num);
+    }
+  }
+  for (; i < n; ++i) {
+    data[i] = T(data[i] * num);
   }
-  return rows_[i];
-} 
+}
 
-Matrix::ProxyRow::ProxyRow(size_t column, int32_t standart_value) {
-  count_column = column;
-  data_ = new int32_t[column];
-  for (size_t i = 0; i < column; ++i) {
-    data_[i] = standart_value;
+// Compares a whole tile branch-free before testing for a difference.
+template <class T>
+bool EqualKernel(const T* a, const T* b, size_t n) {
+  size_t i = 0;
+  for (; i + kTile<T> <= n; i += kTile<T>) {
+    bool diff = false;
+    for (size_t k = 0; k < kTile<T>; ++k) {
+      diff |= a[i + k] != b[i + k];
+    }
+    if (diff) {
+      return false;
+    }
+  }
+  for (; i < n; ++i) {
+    if (a[i] != b[i]) {
+      return false;
+    }
   }
+  return true;
 }
 
-Matrix::Matrix(size_t rows, size_t column, int32_t standart_value) {
-  count_rows = rows;
-  count_column = column;
-  rows_ = new ProxyRow[rows];
-  for (size_t i = 0; i < rows; ++i) {
-    Matrix::ProxyRow row(column, standart_value);
-    rows_[i] = row;
-    row.data_ = nullptr;
+// to(j, i) = from(i, j) for the rows x columns block from. The longer side
+// is halved until the block is a leaf, so at some depth the blocks fit in
+// each level of cache without knowing its size.
+template <class T>
+void TransposeBlock(const T* from, size_t from_stride, T* to,
+                    size_t to_stride, size_t rows, size_t columns) {
+  if (rows <= kTransposeLeaf && columns <= kTransposeLeaf) {
+    for (size_t i = 0; i < rows; ++i) {
+      for (size_t j = 0; j < columns; ++j) {
+        to[j * to_stride + i] = from[i * from_stride + j];
+      }
+    }
+  } else if (rows >= columns) {
+    size_t half = rows / 2;
+    TransposeBlock(from, from_stride, to, to_stride, half, columns);
+    TransposeBlock(from + half * from_stride, from_stride, to + half,
+                   to_stride, rows - half, columns);
+  } else {
+    size_t half = columns / 2;
+    TransposeBlock(from, from_stride, to, to_stride, rows, half);
+    TransposeBlock(from + half, from_stride, to + half * to_stride,
+                   to_stride, rows, columns - half);
   }
 }
 
-Matrix::Matrix(const Matrix& matrix) {
-  size_t rows = matrix.getRows();
-  size_t column = matrix.getColumns();
-  count_rows = rows;
-  count_column = column;
-  rows_ = new ProxyRow[rows];
-  for (size_t i = 0; i < rows; ++i) {
-    Matrix::ProxyRow row(column);
-    rows_[i] = row;
-    row.data_ = nullptr;
-  }
-  for (size_t i = 0; i < rows; ++i) {
-    for(size_t j = 0; j < column; ++j) {
-      (*this)[i][j] = matrix[i][j];
+// Swaps a(i, j) with b(j, i) for the rows x columns block a and the
+// columns x rows block b of one matrix, halving like TransposeBlock.
+template <class T>
+void TransposeSwap(T* a, T* b, size_t stride, size_t rows, size_t columns) {
+  if (rows <= kTransposeLeaf && columns <= kTransposeLeaf) {
+    for (size_t i = 0; i < rows; ++i) {
+      for (size_t j = 0; j < columns; ++j) {
+        std::swap(a[i * stride + j], b[j * stride + i]);
+      }
     }
+  } else if (rows >= columns) {
+    size_t half = rows / 2;
+    TransposeSwap(a, b, stride, half, columns);
+    TransposeSwap(a + half * stride, b + half, stride, rows - half, columns);
+  } else {
+    size_t half = columns / 2;
+    TransposeSwap(a, b, stride, rows, half);
+    TransposeSwap(a + half, b + half * stride, stride, rows, columns - half);
   }
 }
 
-Matrix::Matrix(const std::vector<std::vector<int32_t> >& vec) {
-  size_t rows = vec.size();
-  size_t column = vec[0].size();
-  count_rows = rows;
-  count_column = column;
-  rows_ = new ProxyRow[rows];
-  for (size_t i = 0; i < rows; ++i) {
-    Matrix::ProxyRow row(column);
-    rows_[i] = row;
-    row.data_ = nullptr;
-  }
-  for (size_t i = 0; i < rows; ++i) {
-    for(size_t j = 0; j < column; ++j) {
-      (*this)[i][j] = vec[i][j];
+// Transposes the n x n block at a in place: both diagonal quarters in
+// place, then the two off-diagonal quarters into each other.
+template <class T>
+void TransposeDiagonal(T* a, size_t stride, size_t n) {
+  if (n <= kTransposeLeaf) {
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t j = 0; j < i; ++j) {
+        std::swap(a[i * stride + j], a[j * stride + i]);
+      }
     }
+    return;
   }
+  size_t half = n / 2;
+  TransposeDiagonal(a, stride, half);
+  TransposeDiagonal(a + half * stride + half, stride, n - half);
+  TransposeSwap(a + half, a + half * stride, stride, half, n - half);
 }
 
-Matrix::Matrix(Matrix&& matrix) {
-  this->rows_ = matrix.rows_;
-  this->count_rows = matrix.count_rows;
-  this->count_column = matrix.count_column;
+}  // namespace
+
+template <class T>
+BasicMatrix<T>::ProxyRow::ProxyRow(T* data, size_t column)
+    : data_(data), count_column(column) {}
+
+template <class T>
+T& BasicMatrix<T>::ProxyRow::operator[](size_t j) const {
+  if (j >= count_column) {
+    throw std::out_of_range("out of columns");
+  }
+  return data_[j];
 }
 
-void Matrix::operator=(const Matrix& matrix) {
-  size_t rows = matrix.getRows();
-  size_t column = matrix.getColumns();
-  count_rows = rows;
-  count_column = column;
-  rows_ = new ProxyRow[rows];
-  for (size_t i = 0; i < rows; ++i) {
-    Matrix::ProxyRow row(column);
-    rows_[i] = row;
-    row.data_ = nullptr;
-  }
-  for (size_t i = 0; i < rows; ++i) {
-    for(size_t j = 0; j < column; ++j) {
-      (*this)[i][j] = matrix[i][j];
-    }
+template <class T>
+typename BasicMatrix<T>::ProxyRow BasicMatrix<T>::operator[](size_t i) const {
+  if (i >= count_rows) {
+    throw std::out_of_range("out of rows");
   }
+  return ProxyRow(data_ + i * count_column, count_column);
 }
 
-Matrix::~Matrix() {
-    delete[] rows_;
+template <class T>
+BasicMatrix<T>::BasicMatrix(size_t rows, size_t column, T standart_value)
+    : count_rows(rows), count_column(column), data_(new T[rows * column]) {
+  std::fill_n(data_, size(), standart_value);
+}
+
+template <class T>
+BasicMatrix<T>::BasicMatrix(size_t rows, size_t column, Uninitialized)
+    : count_rows(rows), count_column(column), data_(new T[rows * column]) {}
+
+template <class T>
+BasicMatrix<T>::BasicMatrix(const BasicMatrix& matrix)
+    : count_rows(matrix.count_rows), count_column(matrix.count_column),
+      data_(new T[matrix.size()]) {
+  std::copy_n(matrix.data_, size(), data_);
 }
 
-Matrix::ProxyRow::~ProxyRow() {
+template <class T>
+BasicMatrix<T>::BasicMatrix(const std::vector<std::vector<T> >& vec)
+    : count_rows(vec.size()), count_column(vec[0].size()),
+      data_(new T[vec.size() * vec[0].size()]) {
+  for (size_t i = 0; i < count_rows; ++i) {
+    std::copy_n(vec[i].begin(), count_column, data_ + i * count_column);
+  }
+}
+
+template <class T>
+BasicMatrix<T>::BasicMatrix(BasicMatrix&& matrix) noexcept
+    : count_rows(matrix.count_rows), count_column(matrix.count_column),
+      data_(matrix.data_) {
+  matrix.data_ = nullptr;
+  matrix.count_rows = 0;
+  matrix.count_column = 0;
+}
+
+template <class T>
+BasicMatrix<T>& BasicMatrix<T>::operator=(const BasicMatrix& matrix) {
+  if (this != &matrix) {
+    Reshape(matrix.count_rows, matrix.count_column);
+    std::copy_n(matrix.data_, size(), data_);
+  }
+  return *this;
+}
+
+template <class T>
+BasicMatrix<T>& BasicMatrix<T>::operator=(BasicMatrix&& matrix) noexcept {
+  if (this != &matrix) {
     delete[] data_;
+    data_ = std::exchange(matrix.data_, nullptr);
+    count_rows = std::exchange(matrix.count_rows, 0);
+    count_column = std::exchange(matrix.count_column, 0);
+  }
+  return *this;
+}
+
+template <class T>
+void BasicMatrix<T>::Reshape(size_t rows, size_t column) {
+  if (rows * column != size()) {
+    T* data = new T[rows * column];
+    delete[] data_;
+    data_ = data;
+  }
+  count_rows = rows;
+  count_column = column;
 }
 
-size_t Matrix::getRows() const {
+template <class T>
+BasicMatrix<T>::~BasicMatrix() {
+  delete[] data_;
+}
+
+template <class T>
+size_t BasicMatrix<T>::getRows() const {
   return count_rows;
 }
 
-size_t Matrix::getColumns() const {
+template <class T>
+size_t BasicMatrix<T>::getColumns() const {
   return count_column;
 }
 
-Matrix& Matrix::operator*=(int32_t num) {
-  for (size_t i = 0; i < count_rows; ++i) {
-    for (size_t j = 0; j < count_column; ++j) {
-      (*this)[i][j] *= num;
-    }
-  }
+template <class T>
+BasicMatrix<T>& BasicMatrix<T>::operator*=(T num) {
+  parallel::parallelFor(size(), kTile<T>, size(),
+                        [&](size_t begin, size_t end) {
+                          ScaleKernel(data_ + begin, num, end - begin);
+                        });
   return *this;
 }
 
-Matrix operator+(const Matrix& m1, const Matrix& m2) {
-  if (m1.count_rows != m2.count_rows || m1.count_column != m2.count_column) {
-    throw std::runtime_error("matrix not equal");
+template <class T>
+BasicMatrix<T> BasicMatrix<T>::transpose() const {
+  BasicMatrix res(count_column, count_rows, Uninitialized());
+  transposeTo<T>(*this, res);
+  return res;
+}
+
+template <class T>
+void BasicMatrix<T>::transposeInPlace() {
+  if (count_rows == count_column) {
+    transposeSquare<T>(*this);
+  } else {
+    *this = transpose();
   }
-  Matrix res(m1.count_rows, m1.count_column);
-  for (size_t i = 0; i < m1.count_rows; ++i) {
-    for (size_t j = 0; j < m1.count_column; ++j) {
-      res[i][j] = m1[i][j] + m2[i][j];
-    }
+}
+
+template <class T>
+bool equal(BasicMatrixView<const T> m1, BasicMatrixView<const T> m2) {
+  if (m1.getRows() != m2.getRows() || m1.getColumns() != m2.getColumns()) {
+    return false;
   }
-  return res;
+  const size_t columns = m1.getColumns();
+  std::atomic<bool> same = true;
+  // Pieces started after a difference was found skip the scan.
+  if (m1.stride() == columns && m2.stride() == columns) {
+    parallel::parallelFor(
+        m1.size(), kTile<T>, m1.size(), [&](size_t begin, size_t end) {
+          if (same.load(std::memory_order_relaxed) &&
+              !EqualKernel(m1.data() + begin, m2.data() + begin,
+                           end - begin)) {
+            same.store(false, std::memory_order_relaxed);
+          }
+        });
+  } else {
+    parallel::parallelFor(
+        m1.getRows(), 1, m1.size(), [&](size_t begin, size_t end) {
+          for (size_t i = begin; i < end; ++i) {
+            if (!same.load(std::memory_order_relaxed)) {
+              return;
+            }
+            if (!EqualKernel(&m1(i, 0), &m2(i, 0), columns)) {
+              same.store(false, std::memory_order_relaxed);
+            }
+          }
+        });
+  }
+  return same;
 }
 
-std::ostream& operator<<(std::ostream& os, const Matrix& matrix) {
+template <class T>
+std::ostream& print(std::ostream& os, BasicMatrixView<const T> matrix) {
   for (size_t i = 0; i < matrix.getRows(); ++i) {
     for (size_t j = 0; j < matrix.getColumns(); ++j) {
-      os << matrix[i][j] << ' ';
+      // Unary + prints int8_t as a number rather than a character.
+      os << +matrix(i, j) << ' ';
     }
     os << '\n';
   }
   return os;
 }
 
-bool operator==(const Matrix& m1, const Matrix& m2) {
-  for (size_t i = 0; i < m1.getRows(); ++i) {
-    for (size_t j = 0; j < m1.getColumns(); ++j) {
-      if (m1[i][j] != m2[i][j]) {
-        return false;
-      }
-    }
+template <class T>
+void transposeTo(BasicMatrixView<const T> from, BasicMatrixView<T> to) {
+  if (from.getRows() != to.getColumns() ||
+      from.getColumns() != to.getRows()) {
+    throw std::runtime_error("matrix not equal");
   }
-  return true;
+  // Bands of rows go to the thread pool; each is transposed recursively.
+  parallel::parallelFor(
+      from.getRows(), kTransposeLeaf, from.size(),
+      [&](size_t begin, size_t end) {
+        TransposeBlock(&from(begin, 0), from.stride(), &to(0, begin),
+                       to.stride(), end - begin, from.getColumns());
+      });
 }
 
-bool operator!=(const Matrix& m1, const Matrix& m2) {
-  return !(m1 == m2);
+template <class T>
+void transposeSquare(BasicMatrixView<T> matrix) {
+  if (matrix.getRows() != matrix.getColumns()) {
+    throw std::runtime_error("matrix not square");
+  }
+  // The band of rows [begin, end) owns its diagonal block and the elements
+  // left of it, which it swaps with their mirror images above the block;
+  // no two bands touch the same element.
+  T* a = matrix.data();
+  const size_t stride = matrix.stride();
+  parallel::parallelFor(
+      matrix.getRows(), kTransposeLeaf, matrix.size(),
+      [&](size_t begin, size_t end) {
+        TransposeDiagonal(a + begin * stride + begin, stride, end - begin);
+        TransposeSwap(a + begin * stride, a + begin, stride, end - begin,
+                      begin);
+      });
 }
 
+template class BasicMatrix<int8_t>;
+template class BasicMatrix<int32_t>;
+template class BasicMatrix<int64_t>;
+template class BasicMatrix<float>;
+template class BasicMatrix<double>;
+
+template bool equal(BasicMatrixView<const int8_t>,
+                    BasicMatrixView<const int8_t>);
+template std::ostream& print(std::ostream&, BasicMatrixView<const int8_t>);
+template void transposeTo(BasicMatrixView<const int8_t>,
+                          BasicMatrixView<int8_t>);
+template void transposeSquare(BasicMatrixView<int8_t>);
+
+template bool equal(BasicMatrixView<const int32_t>,
+                    BasicMatrixView<const int32_t>);
+template std::ostream& print(std::ostream&, BasicMatrixView<const int32_t>);
+template void transposeTo(BasicMatrixView<const int32_t>,
+                          BasicMatrixView<int32_t>);
+template void transposeSquare(BasicMatrixView<int32_t>);
+
+template bool equal(BasicMatrixView<const int64_t>,
+                    BasicMatrixView<const int64_t>);
+template std::ostream& print(std::ostream&, BasicMatrixView<const int64_t>);
+template void transposeTo(BasicMatrixView<const int64_t>,
+                          BasicMatrixView<int64_t>);
+template void transposeSquare(BasicMatrixView<int64_t>);
+
+template bool equal(BasicMatrixView<const float>,
+                    BasicMatrixView<const float>);
+template std::ostream& print(std::ostream&, BasicMatrixView<const float>);
+template void transposeTo(BasicMatrixView<const float>,
+                          BasicMatrixView<float>);
+template void transposeSquare(BasicMatrixView<float>);
 
+template bool equal(BasicMatrixView<const double>,
+                    BasicMatrixView<const double>);
+template std::ostream& print(std::ostream&, BasicMatrixView<const double>);
+template void transposeTo(BasicMatrixView<const double>,
+                          BasicMatrixView<double>);
+template void transposeSquare(BasicMatrixView<double>);
@@ -0,0 +1,536 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "matrix.hh"
+#include "parallel.hh"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MATRIX_X86 1
+#endif
+
+namespace {
+
+// The product is built from kMr x kNr register tiles. Around them, a
+// kKc x kNc panel of B is packed once and reused by every row block, and a
+// kMc x kKc block of A is packed so that one kMr-row sliver of it and one
+// kNr-column sliver of B stay in L1 while the microkernel runs.
+constexpr size_t kMr = 6;
+constexpr size_t kMc = 120;
+constexpr size_t kKc = 256;
+constexpr size_t kNc = 2048;
+
+static_assert(kMc % kMr == 0);
+
+// Products of at most this many multiply-adds skip packing altogether;
+// from about 8 x 8 x 8 on, the packed kernels win again.
+constexpr size_t kSmallProduct = 8 * 8 * 8;
+
+// Per element type: In is what the matrices hold, Packed what the packed
+// panels hold, and Acc what the microkernel accumulates and adds into the
+// result. Integer products accumulate unsigned so that overflow wraps
+// instead of being undefined. kNr columns fill two AVX2 registers, and
+// kPair is the number of consecutive k the kernel consumes at once.
+template <class T>
+struct GemmTraits;
+
+// int8 is widened to int16 while packing so vpmaddwd can multiply and add
+// pairs of k into int32 lanes.
+template <>
+struct GemmTraits<int8_t> {
+  using In = int8_t;
+  using Packed = int16_t;
+  using Acc = uint32_t;
+  static constexpr size_t kNr = 16;
+  static constexpr size_t kPair = 2;
+};
+
+template <>
+struct GemmTraits<int32_t> {
+  using In = int32_t;
+  using Packed = int32_t;
+  using Acc = uint32_t;
+  static constexpr size_t kNr = 16;
+  static constexpr size_t kPair = 1;
+};
+
+template <>
+struct GemmTraits<int64_t> {
+  using In = int64_t;
+  using Packed = int64_t;
+  using Acc = uint64_t;
+  static constexpr size_t kNr = 8;
+  static constexpr size_t kPair = 1;
+};
+
+template <>
+struct GemmTraits<float> {
+  using In = float;
+  using Packed = float;
+  using Acc = float;
+  static constexpr size_t kNr = 16;
+  static constexpr size_t kPair = 1;
+};
+
+template <>
+struct GemmTraits<double> {
+  using In = double;
+  using Packed = double;
+  using Acc = double;
+  static constexpr size_t kNr = 8;
+  static constexpr size_t kPair = 1;
+};
+
+// int32 inputs with signed accumulators wide enough never to overflow, for
+// multiplyChecked: int64 when the operands bound every sum below 2^63,
+// 128 bits otherwise.
+__extension__ typedef __int128 Int128;
+
+template <class Wide>
+struct CheckedTraits {
+  using In = int32_t;
+  using Packed = int32_t;
+  using Acc = Wide;
+  static constexpr size_t kNr = 16;
+  static constexpr size_t kPair = 1;
+};
+
+template <class Traits>
+constexpr bool kIsChecked = false;
+
+template <class Wide>
+constexpr bool kIsChecked<CheckedTraits<Wide>> = true;
+
+// Adds the product of a packed kMr-row sliver of A and a packed kNr-column
+// sliver of B, both kc long (a multiple of kPair), into the rows x cols
+// corner of c.
+template <class Traits>
+using MicroKernel = void (*)(size_t kc, const typename Traits::Packed* a,
+                             const typename Traits::Packed* b,
+                             typename Traits::Acc* c, size_t ldc,
+                             size_t rows, size_t cols);
+
+// Copies rows x kc of a into kMr-row slivers, k-major in groups of kPair,
+// zero-padding the last sliver and k up to a multiple of kPair.
+template <class Traits>
+void PackA(const typename Traits::In* a, size_t lda, size_t rows, size_t kc,
+           typename Traits::Packed* out) {
+  constexpr size_t pair = Traits::kPair;
+  for (size_t i = 0; i < rows; i += kMr) {
+    size_t height = std::min(kMr, rows - i);
+    for (size_t p = 0; p < kc; p += pair) {
+      for (size_t r = 0; r < kMr; ++r) {
+        for (size_t q = 0; q < pair; ++q) {
+          bool inside = r < height && p + q < kc;
+          *out++ = inside ? a[(i + r) * lda + p + q] : 0;
+        }
+      }
+    }
+  }
+}
+
+// Copies kc x cols of b into kNr-column slivers, k-major in groups of
+// kPair, zero-padding the last sliver and k up to a multiple of kPair.
+template <class Traits>
+void PackB(const typename Traits::In* b, size_t ldb, size_t kc, size_t cols,
+           typename Traits::Packed* out) {
+  constexpr size_t pair = Traits::kPair;
+  for (size_t j = 0; j < cols; j += Traits::kNr) {
+    size_t width = std::min(Traits::kNr, cols - j);
+    for (size_t p = 0; p < kc; p += pair) {
+      for (size_t c = 0; c < Traits::kNr; ++c) {
+        for (size_t q = 0; q < pair; ++q) {
+          bool inside = c < width && p + q < kc;
+          *out++ = inside ? b[(p + q) * ldb + j + c] : 0;
+        }
+      }
+    }
+  }
+}
+
+// Portable microkernel body, shared by the scalar kernel and by the
+// generic AVX2 build of it.
+template <class Traits>
+__attribute__((always_inline)) inline void MicroKernelBody(
+    size_t kc, const typename Traits::Packed* a,
+    const typename Traits::Packed* b, typename Traits::Acc* c, size_t ldc,
+    size_t rows, size_t cols) {
+  using Acc = typename Traits::Acc;
+  constexpr size_t nr = Traits::kNr, pair = Traits::kPair;
+  Acc acc[kMr][nr] = {};
+  for (size_t p = 0; p < kc; p += pair) {
+    for (size_t r = 0; r < kMr; ++r) {
+      for (size_t j = 0; j < nr; ++j) {
+        for (size_t q = 0; q < pair; ++q) {
+          acc[r][j] += Acc(a[r * pair + q]) * Acc(b[j * pair + q]);
+        }
+      }
+    }
+    a += kMr * pair;
+    b += nr * pair;
+  }
+  for (size_t r = 0; r < rows; ++r) {
+    for (size_t j = 0; j < cols; ++j) {
+      c[r * ldc + j] += acc[r][j];
+    }
+  }
+}
+
+template <class Traits>
+void MicroKernelScalar(size_t kc, const typename Traits::Packed* a,
+                       const typename Traits::Packed* b,
+                       typename Traits::Acc* c, size_t ldc, size_t rows,
+                       size_t cols) {
+  MicroKernelBody<Traits>(kc, a, b, c, ldc, rows, cols);
+}
+
+#ifdef MATRIX_X86
+
+// The portable body compiled for AVX2, for the types without a hand
+// written kernel: int64, which has no 64-bit vector multiply before
+// AVX-512, and the int64-accumulating checked product.
+template <class Traits>
+__attribute__((target("avx2"))) void MicroKernelAutoAvx2(
+    size_t kc, const typename Traits::Packed* a,
+    const typename Traits::Packed* b, typename Traits::Acc* c, size_t ldc,
+    size_t rows, size_t cols) {
+  MicroKernelBody<Traits>(kc, a, b, c, ldc, rows, cols);
+}
+
+// Adds the twelve accumulator registers of a 6 x 16 int32 tile into c.
+__attribute__((target("avx2"))) inline void StoreTileAvx2(
+    const __m256i (&acc)[kMr][2], uint32_t* c, size_t ldc, size_t rows,
+    size_t cols) {
+  if (rows == kMr && cols == 16) {
+    for (size_t r = 0; r < kMr; ++r) {
+      for (size_t half = 0; half < 2; ++half) {
+        __m256i* out = reinterpret_cast<__m256i*>(c + r * ldc + half * 8);
+        _mm256_storeu_si256(
+            out, _mm256_add_epi32(_mm256_loadu_si256(out), acc[r][half]));
+      }
+    }
+    return;
+  }
+  uint32_t tile[kMr][16];
+  for (size_t r = 0; r < kMr; ++r) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(tile[r]), acc[r][0]);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(tile[r] + 8), acc[r][1]);
+  }
+  for (size_t r = 0; r < rows; ++r) {
+    for (size_t j = 0; j < cols; ++j) {
+      c[r * ldc + j] += tile[r][j];
+    }
+  }
+}
+
+// Twelve accumulators hold the 6 x 16 tile; each step broadcasts one
+// element of A against two vectors of B with vpmulld.
+__attribute__((target("avx2"))) void MicroKernelInt32Avx2(
+    size_t kc, const int32_t* a, const int32_t* b, uint32_t* c, size_t ldc,
+    size_t rows, size_t cols) {
+  __m256i acc[kMr][2];
+#pragma GCC unroll 6
+  for (size_t r = 0; r < kMr; ++r) {
+    acc[r][0] = _mm256_setzero_si256();
+    acc[r][1] = _mm256_setzero_si256();
+  }
+  for (size_t p = 0; p < kc; ++p) {
+    __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+    __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + 8));
+#pragma GCC unroll 6
+    for (size_t r = 0; r < kMr; ++r) {
+      __m256i value = _mm256_set1_epi32(a[r]);
+      acc[r][0] = _mm256_add_epi32(acc[r][0], _mm256_mullo_epi32(value, b0));
+      acc[r][1] = _mm256_add_epi32(acc[r][1], _mm256_mullo_epi32(value, b1));
+    }
+    a += kMr;
+    b += 16;
+  }
+  StoreTileAvx2(acc, c, ldc, rows, cols);
+}
+
+// Same tile for int8 widened to int16: each step broadcasts a pair of A
+// elements and vpmaddwd multiplies them with a pair of B rows, summing both
+// products into the int32 lane of the column.
+__attribute__((target("avx2"))) void MicroKernelInt8Avx2(
+    size_t kc, const int16_t* a, const int16_t* b, uint32_t* c, size_t ldc,
+    size_t rows, size_t cols) {
+  __m256i acc[kMr][2];
+#pragma GCC unroll 6
+  for (size_t r = 0; r < kMr; ++r) {
+    acc[r][0] = _mm256_setzero_si256();
+    acc[r][1] = _mm256_setzero_si256();
+  }
+  for (size_t p = 0; p < kc; p += 2) {
+    __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+    __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + 16));
+#pragma GCC unroll 6
+    for (size_t r = 0; r < kMr; ++r) {
+      int32_t pair;
+      std::memcpy(&pair, a + 2 * r, sizeof(pair));
+      __m256i value = _mm256_set1_epi32(pair);
+      acc[r][0] = _mm256_add_epi32(acc[r][0], _mm256_madd_epi16(value, b0));
+      acc[r][1] = _mm256_add_epi32(acc[r][1], _mm256_madd_epi16(value, b1));
+    }
+    a += 2 * kMr;
+    b += 32;
+  }
+  StoreTileAvx2(acc, c, ldc, rows, cols);
+}
+
+// Adds the accumulator registers of a 6 x kNr floating-point tile into c.
+template <class T, class Vector, size_t kLanes>
+__attribute__((target("avx2,fma"))) inline void StoreTileFma(
+    const Vector (&acc)[kMr][2], T* c, size_t ldc, size_t rows,
+    size_t cols) {
+  T tile[kMr][2 * kLanes];
+  for (size_t r = 0; r < kMr; ++r) {
+    std::memcpy(tile[r], &acc[r][0], sizeof(Vector));
+    std::memcpy(tile[r] + kLanes, &acc[r][1], sizeof(Vector));
+  }
+  for (size_t r = 0; r < rows; ++r) {
+    for (size_t j = 0; j < cols; ++j) {
+      c[r * ldc + j] += tile[r][j];
+    }
+  }
+}
+
+// 6 x 16 float tile, one fused multiply-add per accumulator and step.
+__attribute__((target("avx2,fma"))) void MicroKernelFloatFma(
+    size_t kc, const float* a, const float* b, float* c, size_t ldc,
+    size_t rows, size_t cols) {
+  __m256 acc[kMr][2];
+#pragma GCC unroll 6
+  for (size_t r = 0; r < kMr; ++r) {
+    acc[r][0] = _mm256_setzero_ps();
+    acc[r][1] = _mm256_setzero_ps();
+  }
+  for (size_t p = 0; p < kc; ++p) {
+    __m256 b0 = _mm256_loadu_ps(b);
+    __m256 b1 = _mm256_loadu_ps(b + 8);
+#pragma GCC unroll 6
+    for (size_t r = 0; r < kMr; ++r) {
+      __m256 value = _mm256_broadcast_ss(a + r);
+      acc[r][0] = _mm256_fmadd_ps(value, b0, acc[r][0]);
+      acc[r][1] = _mm256_fmadd_ps(value, b1, acc[r][1]);
+    }
+    a += kMr;
+    b += 16;
+  }
+  StoreTileFma<float, __m256, 8>(acc, c, ldc, rows, cols);
+}
+
+// 6 x 8 double tile, one fused multiply-add per accumulator and step.
+__attribute__((target("avx2,fma"))) void MicroKernelDoubleFma(
+    size_t kc, const double* a, const double* b, double* c, size_t ldc,
+    size_t rows, size_t cols) {
+  __m256d acc[kMr][2];
+#pragma GCC unroll 6
+  for (size_t r = 0; r < kMr; ++r) {
+    acc[r][0] = _mm256_setzero_pd();
+    acc[r][1] = _mm256_setzero_pd();
+  }
+  for (size_t p = 0; p < kc; ++p) {
+    __m256d b0 = _mm256_loadu_pd(b);
+    __m256d b1 = _mm256_loadu_pd(b + 4);
+#pragma GCC unroll 6
+    for (size_t r = 0; r < kMr; ++r) {
+      __m256d value = _mm256_broadcast_sd(a + r);
+      acc[r][0] = _mm256_fmadd_pd(value, b0, acc[r][0]);
+      acc[r][1] = _mm256_fmadd_pd(value, b1, acc[r][1]);
+    }
+    a += kMr;
+    b += 8;
+  }
+  StoreTileFma<double, __m256d, 4>(acc, c, ldc, rows, cols);
+}
+
+bool HasAvx2() { return __builtin_cpu_supports("avx2"); }
+
+bool HasFma() { return HasAvx2() && __builtin_cpu_supports("fma"); }
+
+#endif  // MATRIX_X86
+
+// Picks the fastest kernel for Traits that this CPU supports.
+template <class Traits>
+MicroKernel<Traits> PickKernel() {
+#ifdef MATRIX_X86
+  using In = typename Traits::In;
+  if constexpr (kIsChecked<Traits> || std::is_same_v<In, int64_t>) {
+    if (HasAvx2()) {
+      return MicroKernelAutoAvx2<Traits>;
+    }
+  } else if constexpr (std::is_same_v<In, int8_t>) {
+    if (HasAvx2()) {
+      return MicroKernelInt8Avx2;
+    }
+  } else if constexpr (std::is_same_v<In, int32_t>) {
+    if (HasAvx2()) {
+      return MicroKernelInt32Avx2;
+    }
+  } else if constexpr (std::is_same_v<In, float>) {
+    if (HasFma()) {
+      return MicroKernelFloatFma;
+    }
+  } else if constexpr (std::is_same_v<In, double>) {
+    if (HasFma()) {
+      return MicroKernelDoubleFma;
+    }
+  }
+#endif
+  return MicroKernelScalar<Traits>;
+}
+
+// Plain i-p-j loops for products too small to repay packing; the inner
+// loop runs along rows of b and c and vectorizes.
+template <class Traits>
+void SmallGemm(const typename Traits::In* a, size_t lda,
+               const typename Traits::In* b, size_t ldb,
+               typename Traits::Acc* c, size_t m, size_t n, size_t k) {
+  using Acc = typename Traits::Acc;
+  for (size_t i = 0; i < m; ++i) {
+    Acc* row = c + i * n;
+    for (size_t p = 0; p < k; ++p) {
+      Acc value = Acc(a[i * lda + p]);
+      const typename Traits::In* from = b + p * ldb;
+      for (size_t j = 0; j < n; ++j) {
+        row[j] += value * Acc(from[j]);
+      }
+    }
+  }
+}
+
+// c (m x n, zero-filled, gapless) += a (m x k) * b (k x n), all row-major;
+// rows of a and b start lda and ldb elements apart. Once a panel of B is
+// packed, row blocks of A are spread over the thread pool, each thread
+// packing into its own buffer.
+template <class Traits>
+void Gemm(const typename Traits::In* a, size_t lda,
+          const typename Traits::In* b, size_t ldb, typename Traits::Acc* c,
+          size_t m, size_t n, size_t k) {
+  using Packed = typename Traits::Packed;
+  constexpr size_t nr = Traits::kNr, pair = Traits::kPair;
+  static const MicroKernel<Traits> kernel = PickKernel<Traits>();
+  if (m * n * k <= kSmallProduct) {
+    SmallGemm<Traits>(a, lda, b, ldb, c, m, n, k);
+    return;
+  }
+  // Sized for the largest panel this product packs and kept between calls.
+  // Workers read it through packed_b: inside the loop body the name of a
+  // thread_local would mean their own, empty, copy.
+  size_t panel = (std::min(k, kKc) + pair - 1) / pair * pair *
+                 ((std::min(n, kNc) + nr - 1) / nr * nr);
+  thread_local std::vector<Packed> panel_b;
+  if (panel_b.size() < panel) {
+    panel_b.resize(panel);
+  }
+  Packed* packed_b = panel_b.data();
+  for (size_t jc = 0; jc < n; jc += kNc) {
+    size_t nc = std::min(kNc, n - jc);
+    for (size_t pc = 0; pc < k; pc += kKc) {
+      size_t kc = std::min(kKc, k - pc);
+      // Length of the packed slivers, padded to whole pairs.
+      size_t kp = (kc + pair - 1) / pair * pair;
+      PackB<Traits>(b + pc * ldb + jc, ldb, kc, nc, packed_b);
+      parallel::parallelFor(
+          m, kMr, m * nc * kc, [&](size_t begin, size_t end) {
+            thread_local std::vector<Packed> packed_a(kMc * kKc);
+            for (size_t ic = begin; ic < end; ic += kMc) {
+              size_t mc = std::min(kMc, end - ic);
+              PackA<Traits>(a + ic * lda + pc, lda, mc, kc,
+                            packed_a.data());
+              for (size_t jr = 0; jr < nc; jr += nr) {
+                for (size_t ir = 0; ir < mc; ir += kMr) {
+                  kernel(kp, packed_a.data() + ir * kp,
+                         packed_b + jr * kp,
+                         c + (ic + ir) * n + jc + jr, n,
+                         std::min(kMr, mc - ir), std::min(nr, nc - jr));
+                }
+              }
+            }
+          });
+    }
+  }
+}
+
+template <class M>
+void CheckShapes(const M& m1, const M& m2) {
+  if (m1.getColumns() != m2.getRows()) {
+    throw std::runtime_error("matrix not multipliable");
+  }
+}
+
+// Largest magnitude among the elements of m.
+uint64_t MaxMagnitude(const Matrix& m) {
+  uint64_t max = 0;
+  for (size_t i = 0; i < m.size(); ++i) {
+    int64_t value = m.data()[i];
+    max = std::max(max, uint64_t(value < 0 ? -value : value));
+  }
+  return max;
+}
+
+// Fills res, which has the shape of the product and whose elements are
+// all overwritten.
+template <class Wide>
+void MultiplyChecked(const Matrix& m1, const Matrix& m2, Matrix& res) {
+  std::vector<Wide> wide(res.size());
+  Gemm<CheckedTraits<Wide>>(m1.data(), m1.stride(), m2.data(), m2.stride(),
+                            wide.data(), m1.getRows(), m2.getColumns(),
+                            m1.getColumns());
+  for (size_t i = 0; i < wide.size(); ++i) {
+    if (wide[i] < std::numeric_limits<int32_t>::min() ||
+        wide[i] > std::numeric_limits<int32_t>::max()) {
+      throw std::overflow_error("matrix overflow");
+    }
+    res.data()[i] = int32_t(wide[i]);
+  }
+}
+
+}  // namespace
+
+template <class T>
+BasicMatrix<ProductOf<T>> multiply(BasicMatrixView<const T> m1,
+                                   BasicMatrixView<const T> m2) {
+  using Traits = GemmTraits<T>;
+  using Acc = typename Traits::Acc;
+  static_assert(sizeof(Acc) == sizeof(ProductOf<T>));
+  CheckShapes(m1, m2);
+  BasicMatrix<ProductOf<T>> res(m1.getRows(), m2.getColumns());
+  // Signed and unsigned integers of one size may alias each other.
+  Gemm<Traits>(m1.data(), m1.stride(), m2.data(), m2.stride(),
+               reinterpret_cast<Acc*>(res.data()), m1.getRows(),
+               m2.getColumns(), m1.getColumns());
+  return res;
+}
+
+Matrix multiplyChecked(const Matrix& m1, const Matrix& m2) {
+  CheckShapes(m1, m2);
+  // A product of two int32 is at most 2^62 in magnitude, so int64 holds
+  // any partial sum of k of them only while k * max|a| * max|b| does.
+  uint64_t term = MaxMagnitude(m1) * MaxMagnitude(m2);
+  size_t k = m1.getColumns();
+  Matrix res(m1.getRows(), m2.getColumns(), Matrix::Uninitialized());
+  if (k == 0 || term <= uint64_t(std::numeric_limits<int64_t>::max()) / k) {
+    MultiplyChecked<int64_t>(m1, m2, res);
+  } else {
+    MultiplyChecked<Int128>(m1, m2, res);
+  }
+  return res;
+}
+
+template BasicMatrix<int32_t> multiply(BasicMatrixView<const int8_t>,
+                                       BasicMatrixView<const int8_t>);
+template BasicMatrix<int32_t> multiply(BasicMatrixView<const int32_t>,
+                                       BasicMatrixView<const int32_t>);
+template BasicMatrix<int64_t> multiply(BasicMatrixView<const int64_t>,
+                                       BasicMatrixView<const int64_t>);
+template BasicMatrix<float> multiply(BasicMatrixView<const float>,
+                                     BasicMatrixView<const float>);
+template BasicMatrix<double> multiply(BasicMatrixView<const double>,
+                                      BasicMatrixView<const double>);
@@ -0,0 +1,167 @@
+#include "parallel.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <utility>
+
+namespace parallel {
+
+namespace {
+
+// Pieces handed out per thread, so uneven pieces still balance.
+constexpr size_t kPiecesPerThread = 4;
+
+thread_local bool in_task = false;
+
+std::mutex config_mutex;
+size_t configured_threads = 0;
+std::atomic<size_t> configured_threshold = size_t(1) << 17;
+std::unique_ptr<ThreadPool> shared_pool;
+
+size_t Resolve(size_t threads) {
+  return threads != 0 ? threads
+                      : std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Returns the shared pool, rebuilding it when the thread count changed.
+ThreadPool& SharedPool() {
+  std::lock_guard<std::mutex> lock(config_mutex);
+  size_t wanted = Resolve(configured_threads);
+  if (!shared_pool || shared_pool->size() != wanted) {
+    shared_pool = std::make_unique<ThreadPool>(wanted);
+  }
+  return *shared_pool;
+}
+
+}  // namespace
+
+ThreadPool::ThreadPool(size_t threads) {
+  for (size_t i = 1; i < threads; ++i) {
+    workers_.emplace_back(&ThreadPool::work, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::run(size_t tasks, FunctionRef<void(size_t)> task) {
+  if (in_task || workers_.empty() || tasks <= 1) {
+    for (size_t i = 0; i < tasks; ++i) {
+      task(i);
+    }
+    return;
+  }
+  std::lock_guard<std::mutex> serialize(run_mutex_);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &task;
+    tasks_ = tasks;
+    next_ = 0;
+    busy_ = workers_.size();
+    error_ = nullptr;
+    ++generation_;
+  }
+  wake_.notify_all();
+  drain();
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this] { return busy_ == 0; });
+  task_ = nullptr;
+  if (error_) {
+    std::rethrow_exception(std::exchange(error_, nullptr));
+  }
+}
+
+// Claims and runs tasks of the current generation until none are left.
+void ThreadPool::drain() {
+  in_task = true;
+  while (true) {
+    size_t index;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (next_ >= tasks_) {
+        break;
+      }
+      index = next_++;
+    }
+    try {
+      (*task_)(index);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_) {
+        error_ = std::current_exception();
+      }
+      next_ = tasks_;
+    }
+  }
+  in_task = false;
+}
+
+void ThreadPool::work() {
+  uint64_t seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+      if (stop_) {
+        return;
+      }
+      seen = generation_;
+    }
+    drain();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --busy_;
+    }
+    done_.notify_one();
+  }
+}
+
+void setThreads(size_t threads) {
+  std::lock_guard<std::mutex> lock(config_mutex);
+  configured_threads = threads;
+}
+
+size_t threads() {
+  std::lock_guard<std::mutex> lock(config_mutex);
+  return Resolve(configured_threads);
+}
+
+void setThreshold(size_t work) { configured_threshold = work; }
+
+size_t threshold() { return configured_threshold; }
+
+void parallelFor(size_t count, size_t grain, size_t work,
+                 FunctionRef<void(size_t, size_t)> body) {
+  if (count == 0) {
+    return;
+  }
+  grain = std::max<size_t>(grain, 1);
+  size_t pieces = 1;
+  if (work >= threshold() && !in_task) {
+    pieces = std::min(threads() * kPiecesPerThread,
+                      (count + grain - 1) / grain);
+  }
+  if (pieces <= 1) {
+    body(0, count);
+    return;
+  }
+  // Piece size rounded up to a whole number of grains.
+  size_t step = (count + pieces - 1) / pieces;
+  step = (step + grain - 1) / grain * grain;
+  pieces = (count + step - 1) / step;
+  SharedPool().run(pieces, [&](size_t piece) {
+    size_t begin = piece * step;
+    body(begin, std::min(count, begin + step));
+  });
+}
+
+}  // namespace parallel
@@ -0,0 +1,420 @@
+#include "sparse.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "parallel.hh"
+
+namespace {
+
+using expr::kTile;
+
+// Parallel sweeps hand out pieces of at least this many nonzeros.
+constexpr size_t kSparseGrain = 1024;
+
+// Products accumulate in the unsigned type of the result for integers, so
+// overflow wraps instead of being undefined, as in the dense product.
+template <class T, bool = std::is_integral_v<T>>
+struct WrappingOf {
+  using type = T;
+};
+
+template <class T>
+struct WrappingOf<T, true> {
+  using type = std::make_unsigned_t<T>;
+};
+
+template <class T>
+using AccumulatorOf = typename WrappingOf<ProductOf<T>>::type;
+
+// First line whose nonzeros start at or after nonzero k. A piece
+// [begin, end) of the nonzeros owns the lines from FirstLineAt(begin) up to
+// FirstLineAt(end), so every line is computed by exactly one piece.
+size_t FirstLineAt(const std::vector<size_t>& offsets, size_t lines,
+                   size_t k) {
+  return std::lower_bound(offsets.begin(), offsets.begin() + lines, k) -
+         offsets.begin();
+}
+
+// Calls body(line) for every one of lines compressed lines, spreading the
+// lines over the thread pool in pieces with equal numbers of nonzeros, so
+// a few dense lines do not leave one thread with most of the work.
+template <class Body>
+void ForEachLine(const std::vector<size_t>& offsets, size_t lines,
+                 size_t work, Body body) {
+  size_t nonzeros = offsets[lines];
+  parallel::parallelFor(nonzeros, kSparseGrain, work,
+                        [&](size_t begin, size_t end) {
+                          size_t first = FirstLineAt(offsets, lines, begin);
+                          size_t last = end == nonzeros
+                                            ? lines
+                                            : FirstLineAt(offsets, lines, end);
+                          for (size_t line = first; line < last; ++line) {
+                            body(line);
+                          }
+                        });
+}
+
+// Compresses the other way: the nonzeros of major lines are bucketed by
+// their minor index with a counting sort, which leaves the new indices
+// sorted within each line.
+template <class T>
+void Regroup(size_t major, size_t minor, const CompressedStorage<T>& from,
+             std::vector<size_t>& offsets, std::vector<uint32_t>& indices,
+             std::vector<T>& values) {
+  offsets.assign(minor + 1, 0);
+  for (uint32_t index : from.indices()) {
+    ++offsets[index + 1];
+  }
+  for (size_t line = 0; line < minor; ++line) {
+    offsets[line + 1] += offsets[line];
+  }
+  indices.resize(from.nonZeros());
+  values.resize(from.nonZeros());
+  std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+  for (size_t line = 0; line < major; ++line) {
+    for (size_t k = from.offsets()[line]; k < from.offsets()[line + 1]; ++k) {
+      size_t to = next[from.indices()[k]]++;
+      indices[to] = uint32_t(line);
+      values[to] = from.values()[k];
+    }
+  }
+}
+
+template <class T>
+size_t CountNonZeros(const T* data, size_t n) {
+  size_t count = 0, i = 0;
+  for (; i + kTile<T> <= n; i += kTile<T>) {
+    uint32_t tile = 0;
+    for (size_t k = 0; k < kTile<T>; ++k) {
+      tile += data[i + k] != T(0);
+    }
+    count += tile;
+  }
+  for (; i < n; ++i) {
+    count += data[i] != T(0);
+  }
+  return count;
+}
+
+// Appends the nonzeros of row[begin, end), at most one tile, at position
+// kept and returns the new count. The tile is compacted into a local buffer
+// by storing every element and advancing only past nonzeros, which avoids
+// a mispredicted branch per element without writing past the kept ones.
+template <class T>
+size_t Compact(const T* row, size_t begin, size_t end, uint32_t* indices,
+               T* values, size_t kept) {
+  uint32_t tile_indices[kTile<T> + 1];
+  T tile_values[kTile<T> + 1];
+  size_t count = 0;
+  for (size_t k = begin; k < end; ++k) {
+    tile_indices[count] = uint32_t(k);
+    tile_values[count] = row[k];
+    count += row[k] != T(0);
+  }
+  std::copy_n(tile_indices, count, indices + kept);
+  std::copy_n(tile_values, count, values + kept);
+  return kept + count;
+}
+
+void CheckSum(size_t rows, size_t columns, size_t dense_rows,
+              size_t dense_columns) {
+  if (rows != dense_rows || columns != dense_columns) {
+    throw std::runtime_error("matrix not equal");
+  }
+}
+
+void CheckProduct(size_t columns, size_t rows) {
+  if (columns != rows) {
+    throw std::runtime_error("matrix not multipliable");
+  }
+}
+
+}  // namespace
+
+template <class T>
+CompressedStorage<T>::CompressedStorage(size_t rows, size_t column,
+                                        size_t major, size_t minor)
+    : count_rows(rows), count_column(column), offsets_(major + 1, 0) {
+  if (minor > size_t(UINT32_MAX) + 1) {
+    throw std::length_error("matrix too large for sparse indices");
+  }
+}
+
+template <class T>
+CompressedStorage<T>::CompressedStorage(size_t rows, size_t column,
+                                        size_t major, size_t minor,
+                                        std::vector<size_t> offsets,
+                                        std::vector<uint32_t> indices,
+                                        std::vector<T> values)
+    : CompressedStorage(rows, column, major, minor) {
+  bool valid = offsets.size() == major + 1 && offsets[0] == 0 &&
+               offsets[major] == indices.size() &&
+               indices.size() == values.size() &&
+               std::is_sorted(offsets.begin(), offsets.end()) &&
+               std::all_of(indices.begin(), indices.end(),
+                           [&](uint32_t index) { return index < minor; });
+  if (!valid) {
+    throw std::invalid_argument("invalid sparse structure");
+  }
+  offsets_ = std::move(offsets);
+  indices_ = std::move(indices);
+  values_ = std::move(values);
+}
+
+template <class T>
+BasicCsrMatrix<T>::BasicCsrMatrix(size_t rows, size_t column)
+    : CompressedStorage<T>(rows, column, rows, column) {}
+
+template <class T>
+BasicCsrMatrix<T>::BasicCsrMatrix(size_t rows, size_t column,
+                                  std::vector<size_t> offsets,
+                                  std::vector<uint32_t> indices,
+                                  std::vector<T> values)
+    : CompressedStorage<T>(rows, column, rows, column, std::move(offsets),
+                           std::move(indices), std::move(values)) {}
+
+// Rows are counted first so the arrays are allocated once at their final
+// size, after which every row is compacted into its own slice; both passes
+// are spread over the thread pool.
+template <class T>
+BasicCsrMatrix<T>::BasicCsrMatrix(const BasicMatrix<T>& dense)
+    : BasicCsrMatrix(dense.getRows(), dense.getColumns()) {
+  const size_t rows = this->count_rows, n = this->count_column;
+  size_t* offsets = this->offsets_.data();
+  parallel::parallelFor(rows, 1, dense.size(), [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      offsets[i + 1] = CountNonZeros(dense.data() + i * n, n);
+    }
+  });
+  for (size_t i = 0; i < rows; ++i) {
+    offsets[i + 1] += offsets[i];
+  }
+  this->indices_.resize(offsets[rows]);
+  this->values_.resize(offsets[rows]);
+  uint32_t* indices = this->indices_.data();
+  T* values = this->values_.data();
+  parallel::parallelFor(rows, 1, dense.size(), [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      if (offsets[i] == offsets[i + 1]) {
+        continue;
+      }
+      const T* row = dense.data() + i * n;
+      size_t kept = offsets[i];
+      size_t j = 0;
+      // All-zero tiles, most of a sparse row, are skipped after one
+      // vectorized test.
+      for (; j + kTile<T> <= n; j += kTile<T>) {
+        bool any = false;
+        for (size_t k = 0; k < kTile<T>; ++k) {
+          any |= row[j + k] != T(0);
+        }
+        if (any) {
+          kept = Compact(row, j, j + kTile<T>, indices, values, kept);
+        }
+      }
+      Compact(row, j, n, indices, values, kept);
+    }
+  });
+}
+
+template <class T>
+BasicCsrMatrix<T>::BasicCsrMatrix(const BasicCscMatrix<T>& csc)
+    : BasicCsrMatrix(csc.getRows(), csc.getColumns()) {
+  Regroup(csc.getColumns(), csc.getRows(), csc, this->offsets_,
+          this->indices_, this->values_);
+}
+
+template <class T>
+BasicMatrix<T> BasicCsrMatrix<T>::toDense() const {
+  BasicMatrix<T> res(this->count_rows, this->count_column);
+  AddTo(res, *this);
+  return res;
+}
+
+template <class T>
+void BasicCsrMatrix<T>::AddTo(BasicMatrix<T>& dense,
+                              const BasicCsrMatrix& sparse) {
+  CheckSum(sparse.getRows(), sparse.getColumns(), dense.getRows(),
+           dense.getColumns());
+  const std::vector<size_t>& offsets = sparse.offsets();
+  for (size_t i = 0; i < sparse.getRows(); ++i) {
+    for (size_t k = offsets[i]; k < offsets[i + 1]; ++k) {
+      T& element = dense(i, sparse.indices()[k]);
+      element = T(element + sparse.values()[k]);
+    }
+  }
+}
+
+template <class T>
+std::vector<ProductOf<T>> BasicCsrMatrix<T>::MultiplyVector(
+    const BasicCsrMatrix& sparse, const std::vector<T>& x) {
+  using Acc = AccumulatorOf<T>;
+  CheckProduct(sparse.getColumns(), x.size());
+  std::vector<ProductOf<T>> y(sparse.getRows());
+  const size_t* offsets = sparse.offsets().data();
+  const uint32_t* indices = sparse.indices().data();
+  const T* values = sparse.values().data();
+  ForEachLine(sparse.offsets(), sparse.getRows(), sparse.nonZeros(),
+              [&](size_t i) {
+                Acc sum = 0;
+                for (size_t k = offsets[i]; k < offsets[i + 1]; ++k) {
+                  sum += Acc(values[k]) * Acc(x[indices[k]]);
+                }
+                y[i] = ProductOf<T>(sum);
+              });
+  return y;
+}
+
+template <class T>
+BasicMatrix<ProductOf<T>> BasicCsrMatrix<T>::MultiplyMatrix(
+    const BasicCsrMatrix& sparse, const BasicMatrix<T>& dense) {
+  using Acc = AccumulatorOf<T>;
+  constexpr size_t tile = kTile<Acc>;
+  CheckProduct(sparse.getColumns(), dense.getRows());
+  const size_t n = dense.getColumns();
+  BasicMatrix<ProductOf<T>> res(sparse.getRows(), n);
+  const size_t* offsets = sparse.offsets().data();
+  const uint32_t* indices = sparse.indices().data();
+  const T* values = sparse.values().data();
+  // Row i of the result is a sum of rows of dense scaled by the nonzeros of
+  // row i. It is built one tile of columns at a time in a local
+  // accumulator, so the tile stays in registers across the nonzeros.
+  ForEachLine(
+      sparse.offsets(), sparse.getRows(), sparse.nonZeros() * n,
+      [&](size_t i) {
+        ProductOf<T>* out = res.data() + i * n;
+        size_t j = 0;
+        for (; j + tile <= n; j += tile) {
+          Acc acc[tile] = {};
+          for (size_t k = offsets[i]; k < offsets[i + 1]; ++k) {
+            Acc value = Acc(values[k]);
+            const T* row = dense.data() + indices[k] * n + j;
+            for (size_t w = 0; w < tile; ++w) {
+              acc[w] += value * Acc(row[w]);
+            }
+          }
+          for (size_t w = 0; w < tile; ++w) {
+            out[j + w] = ProductOf<T>(acc[w]);
+          }
+        }
+        for (; j < n; ++j) {
+          Acc sum = 0;
+          for (size_t k = offsets[i]; k < offsets[i + 1]; ++k) {
+            sum += Acc(values[k]) * Acc(dense(indices[k], j));
+          }
+          out[j] = ProductOf<T>(sum);
+        }
+      });
+  return res;
+}
+
+template <class T>
+BasicCscMatrix<T>::BasicCscMatrix(size_t rows, size_t column)
+    : CompressedStorage<T>(rows, column, column, rows) {}
+
+template <class T>
+BasicCscMatrix<T>::BasicCscMatrix(size_t rows, size_t column,
+                                  std::vector<size_t> offsets,
+                                  std::vector<uint32_t> indices,
+                                  std::vector<T> values)
+    : CompressedStorage<T>(rows, column, column, rows, std::move(offsets),
+                           std::move(indices), std::move(values)) {}
+
+// Reading the dense matrix column by column would stride through memory,
+// so it is compressed by rows and regrouped.
+template <class T>
+BasicCscMatrix<T>::BasicCscMatrix(const BasicMatrix<T>& dense)
+    : BasicCscMatrix(BasicCsrMatrix<T>(dense)) {}
+
+template <class T>
+BasicCscMatrix<T>::BasicCscMatrix(const BasicCsrMatrix<T>& csr)
+    : BasicCscMatrix(csr.getRows(), csr.getColumns()) {
+  Regroup(csr.getRows(), csr.getColumns(), csr, this->offsets_,
+          this->indices_, this->values_);
+}
+
+template <class T>
+BasicMatrix<T> BasicCscMatrix<T>::toDense() const {
+  BasicMatrix<T> res(this->count_rows, this->count_column);
+  AddTo(res, *this);
+  return res;
+}
+
+template <class T>
+void BasicCscMatrix<T>::AddTo(BasicMatrix<T>& dense,
+                              const BasicCscMatrix& sparse) {
+  CheckSum(sparse.getRows(), sparse.getColumns(), dense.getRows(),
+           dense.getColumns());
+  const std::vector<size_t>& offsets = sparse.offsets();
+  for (size_t j = 0; j < sparse.getColumns(); ++j) {
+    for (size_t k = offsets[j]; k < offsets[j + 1]; ++k) {
+      T& element = dense(sparse.indices()[k], j);
+      element = T(element + sparse.values()[k]);
+    }
+  }
+}
+
+template <class T>
+std::vector<ProductOf<T>> BasicCscMatrix<T>::MultiplyVector(
+    const BasicCscMatrix& sparse, const std::vector<T>& x) {
+  using Acc = AccumulatorOf<T>;
+  CheckProduct(sparse.getColumns(), x.size());
+  std::vector<Acc> acc(sparse.getRows());
+  const std::vector<size_t>& offsets = sparse.offsets();
+  for (size_t j = 0; j < sparse.getColumns(); ++j) {
+    Acc factor = Acc(x[j]);
+    for (size_t k = offsets[j]; k < offsets[j + 1]; ++k) {
+      acc[sparse.indices()[k]] += Acc(sparse.values()[k]) * factor;
+    }
+  }
+  return std::vector<ProductOf<T>>(acc.begin(), acc.end());
+}
+
+template <class T>
+BasicMatrix<ProductOf<T>> BasicCscMatrix<T>::MultiplyMatrix(
+    const BasicMatrix<T>& dense, const BasicCscMatrix& sparse) {
+  using Acc = AccumulatorOf<T>;
+  CheckProduct(dense.getColumns(), sparse.getRows());
+  const size_t m = dense.getRows(), n = sparse.getColumns();
+  BasicMatrix<ProductOf<T>> res(m, n);
+  const size_t* offsets = sparse.offsets().data();
+  const uint32_t* indices = sparse.indices().data();
+  const T* values = sparse.values().data();
+  // Element (i, j) gathers row i of dense at the nonzero rows of column j.
+  parallel::parallelFor(
+      m, 1, m * sparse.nonZeros(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          const T* row = dense.data() + i * dense.getColumns();
+          for (size_t j = 0; j < n; ++j) {
+            Acc sum = 0;
+            for (size_t k = offsets[j]; k < offsets[j + 1]; ++k) {
+              sum += Acc(row[indices[k]]) * Acc(values[k]);
+            }
+            res(i, j) = ProductOf<T>(sum);
+          }
+        }
+      });
+  return res;
+}
+
+template class CompressedStorage<int8_t>;
+template class CompressedStorage<int32_t>;
+template class CompressedStorage<int64_t>;
+template class CompressedStorage<float>;
+template class CompressedStorage<double>;
+
+template class BasicCsrMatrix<int8_t>;
+template class BasicCsrMatrix<int32_t>;
+template class BasicCsrMatrix<int64_t>;
+template class BasicCsrMatrix<float>;
+template class BasicCsrMatrix<double>;
+
+template class BasicCscMatrix<int8_t>;
+template class BasicCscMatrix<int32_t>;
+template class BasicCscMatrix<int64_t>;
+template class BasicCscMatrix<float>;
+template class BasicCscMatrix<double>;